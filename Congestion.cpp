@@ -0,0 +1,113 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+
+#include "Congestion.h"
+
+// Utilization in percent above which each level starts, a level is left 5% under it
+static const uint8_t levelThreshold[] = { 0, 50, 75, 90 };
+#define CONGESTION_HYSTERESIS 5
+
+//Constructor
+CongestionMonitor::CongestionMonitor(uint16_t capacity)
+  : capacity_(capacity ? capacity : 1), frames_(0), periodStart_(0), utilization_(0),
+    level_(LOAD_IDLE), started_(false) { }
+
+void CongestionMonitor::onFrame() {
+  update();
+  if (frames_ < 0xFFFF) frames_++;
+}
+
+// Closes the elapsed periods and moves the level
+void CongestionMonitor::update() {
+  uint32_t now = millis();
+  // A global instance is built before the timer runs, the first period starts here
+  if (!started_) {
+    started_ = true;
+    periodStart_ = now;
+  }
+  uint32_t periods = (now - periodStart_) / CONGESTION_PERIOD;
+  if (periods) {
+    uint32_t sample = (uint32_t)frames_ * 100 * 16 / capacity_;
+    if (sample > 100 * 16) sample = 100 * 16;
+    utilization_ = (utilization_ * 3 + sample) / 4;
+    // The next periods had no frame, past 16 of them nothing is left
+    for (uint32_t i = 1; i < periods && i < 16; i++) {
+      utilization_ = utilization_ * 3 / 4;
+    }
+    frames_ = 0;
+    periodStart_ += periods * CONGESTION_PERIOD;
+  }
+
+  uint8_t percent = utilization_ / 16;
+  uint8_t level = level_;
+  while (level < LOAD_SATURATED && percent >= levelThreshold[level + 1]) level++;
+  while (level > LOAD_IDLE && percent + CONGESTION_HYSTERESIS < levelThreshold[level]) level--;
+  level_ = (Load_level)level;
+}
+
+uint8_t CongestionMonitor::utilization() {
+  update();
+  return utilization_ / 16;
+}
+
+Load_level CongestionMonitor::level() {
+  update();
+  return level_;
+}
+
+bool CongestionMonitor::stamp(MessageHelper& msg) {
+  uint8_t level = this->level();
+  return msg.setExtension(X_LOAD, &level, 1);
+}
+
+//Constructor
+AdaptiveReporter::AdaptiveReporter() : level_(LOAD_IDLE), heard_(0) { }
+
+void AdaptiveReporter::onMessage(const MessageHelper& msg) {
+  uint8_t length;
+  const uint8_t* value = msg.findExtension(X_LOAD, &length);
+  if (value && length == 1 && *value <= LOAD_SATURATED) {
+    level_ = (Load_level)*value;
+    heard_ = millis();
+  }
+}
+
+Load_level AdaptiveReporter::level() const {
+  if (level_ != LOAD_IDLE && millis() - heard_ >= ADAPTIVE_HOLD) {
+    return LOAD_IDLE;
+  }
+  return level_;
+}
+
+bool AdaptiveReporter::isSafety(Sensor_type type) {
+  switch (type) {
+    case S_DOOR:
+    case S_MOTION:
+    case S_SMOKE:
+    case S_LOCK:
+    case S_WATER_LEAK:
+      return true;
+    default:
+      return false;
+  }
+}
+
+uint8_t AdaptiveReporter::factor(Sensor_type type) const {
+  if (isSafety(type)) {
+    return 1;
+  }
+  uint8_t factor = 1 << level();
+  return factor < ADAPTIVE_MAX_FACTOR ? factor : ADAPTIVE_MAX_FACTOR;
+}
+
+uint32_t AdaptiveReporter::interval(uint32_t base, Sensor_type type) const {
+  return base * factor(type);
+}
+
+float AdaptiveReporter::deadband(float base, Sensor_type type) const {
+  return base * factor(type);
+}
@@ -0,0 +1,100 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file Congestion.h
+ *
+ * @brief Congestion signal from the gateway and adaptive reporting on the nodes
+ *
+ * The gateway counts the frames it receives and sends: every
+ * CONGESTION_PERIOD ms the count, compared to the capacity of the channel,
+ * gives the utilization, smoothed over a few periods. CongestionMonitor::stamp()
+ * adds the load level to the messages sent to the nodes (ACKs,
+ * C_PRESENTATION_PARENT beacons) as the X_LOAD extension.
+ *
+ * A node gives every message it receives to AdaptiveReporter::onMessage() and
+ * multiplies its reporting intervals and deadbands by factor(): 1 when the
+ * channel is idle, 2 per load level, up to ADAPTIVE_MAX_FACTOR. Without news
+ * from the gateway for ADAPTIVE_HOLD ms the node goes back to its normal rate.
+ * Safety sensors (isSafety()) always report at their normal rate.
+ */
+#ifndef CONGESTION_H
+#define CONGESTION_H
+
+#include <Arduino.h>
+#include "Message.h"
+
+/// @brief Measure period in ms
+#ifndef CONGESTION_PERIOD
+#define CONGESTION_PERIOD 1000
+#endif
+/// @brief Frames per period the channel carries at full utilization
+#ifndef CONGESTION_CAPACITY
+#define CONGESTION_CAPACITY 100
+#endif
+/// @brief Largest interval and deadband multiplier of the nodes
+#ifndef ADAPTIVE_MAX_FACTOR
+#define ADAPTIVE_MAX_FACTOR 8
+#endif
+/// @brief Time in ms a load level advertised by the gateway stays valid
+#ifndef ADAPTIVE_HOLD
+#define ADAPTIVE_HOLD 60000
+#endif
+
+/// @brief Load level advertised by the gateway
+typedef enum : unsigned char {
+	LOAD_IDLE				= 0,	//!< Utilization under 50%
+	LOAD_ELEVATED			= 1,	//!< Utilization over 50%
+	LOAD_HIGH				= 2,	//!< Utilization over 75%
+	LOAD_SATURATED			= 3		//!< Utilization over 90%
+} Load_level;
+
+
+class CongestionMonitor {
+
+ public:
+	/// @param capacity frames per CONGESTION_PERIOD at full utilization, 0 is taken as 1
+	CongestionMonitor(uint16_t capacity = CONGESTION_CAPACITY);
+	/// @brief Counts a frame received or sent by the gateway
+	void onFrame();
+	/// @brief Smoothed utilization in percent
+	uint8_t utilization();
+	Load_level level();
+	/// @brief Adds the load level to a message sent to a node
+	bool stamp(MessageHelper& msg);
+
+ private:
+	void update();
+
+	uint16_t capacity_;
+	uint16_t frames_;
+	uint32_t periodStart_;
+	uint16_t utilization_;	// percent * 16
+	Load_level level_;
+	bool started_;
+};
+
+
+class AdaptiveReporter {
+
+ public:
+	AdaptiveReporter();
+	/// @brief Reads the load level advertised in a message from the gateway
+	void onMessage(const MessageHelper& msg);
+	Load_level level() const;
+	/// @brief Multiplier of the intervals and deadbands of the sensors of type @p type
+	uint8_t factor(Sensor_type type) const;
+	uint32_t interval(uint32_t base, Sensor_type type) const;
+	float deadband(float base, Sensor_type type) const;
+	/// @brief Alarms and locks, they never slow down
+	static bool isSafety(Sensor_type type);
+
+ private:
+	Load_level level_;
+	uint32_t heard_;
+};
+
+#endif
@@ -0,0 +1,164 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+
+#include "ControllerFanout.h"
+#include "PayloadParser.h"
+
+//Constructor
+ControllerFanout::ControllerFanout() {
+  for (uint8_t i = 0; i < FANOUT_MAX_SUBSCRIBERS; i++) {
+    subscribers_[i].link = NULL;
+  }
+  next_ = 0;
+  unserialized_ = 0;
+}
+
+int8_t ControllerFanout::subscribe(Stream* link, const Fanout_filter& filter, bool checkSpace) {
+  for (uint8_t i = 0; i < FANOUT_MAX_SUBSCRIBERS; i++) {
+    Subscriber& s = subscribers_[i];
+    if (s.link == NULL) {
+      s.link = link;
+      s.filter = filter;
+      s.checkSpace = checkSpace;
+      s.dropped = 0;
+      s.rxLength = 0;
+      return i;
+    }
+  }
+  return -1;
+}
+
+void ControllerFanout::unsubscribe(int8_t id) {
+  if (id >= 0 && id < FANOUT_MAX_SUBSCRIBERS) {
+    subscribers_[id].link = NULL;
+  }
+}
+
+void ControllerFanout::setFilter(int8_t id, const Fanout_filter& filter) {
+  if (id >= 0 && id < FANOUT_MAX_SUBSCRIBERS) {
+    subscribers_[id].filter = filter;
+  }
+}
+
+uint16_t ControllerFanout::dropped(int8_t id) const {
+  return id >= 0 && id < FANOUT_MAX_SUBSCRIBERS ? subscribers_[id].dropped : 0;
+}
+
+uint16_t ControllerFanout::unserialized() const {
+  return unserialized_;
+}
+
+bool ControllerFanout::matches(const Fanout_filter& filter, const MessageHelper& msg) const {
+  return (filter.commands & (1 << msg.getCommand())) &&
+         (filter.address == FANOUT_ANY_ADDRESS || filter.address == msg.getSensorAddress()) &&
+         (filter.sensorId == FANOUT_ANY_SENSOR || filter.sensorId == msg.getSensorID());
+}
+
+uint8_t ControllerFanout::publish(const MessageHelper& msg) {
+  uint16_t length = 0;
+  uint8_t sent = 0;
+  for (uint8_t i = 0; i < FANOUT_MAX_SUBSCRIBERS; i++) {
+    Subscriber& s = subscribers_[i];
+    if (s.link == NULL || !matches(s.filter, msg)) {
+      continue;
+    }
+    // Serialized on the first match only, then shared
+    if (length == 0) {
+      length = msg.serialize(line_, sizeof(line_));
+      if (length == 0) {
+        unserialized_++;
+        return 0;
+      }
+    }
+    if (s.checkSpace && s.link->availableForWrite() < length) {
+      s.dropped++;
+      continue;
+    }
+    if (s.link->write((const uint8_t*)line_, length) != length) {
+      s.dropped++;
+      continue;
+    }
+    sent++;
+  }
+  return sent;
+}
+
+bool ControllerFanout::poll(MessageHelper& msg, int8_t* from) {
+  for (uint8_t n = 0; n < FANOUT_MAX_SUBSCRIBERS; n++) {
+    uint8_t i = next_;
+    next_ = (next_ + 1) % FANOUT_MAX_SUBSCRIBERS;
+    Subscriber& s = subscribers_[i];
+    if (s.link == NULL) {
+      continue;
+    }
+    while (s.link->available() > 0) {
+      char c = s.link->read();
+      if (c == '\r') {
+        continue;
+      }
+      if (c != '\n') {
+        // An overlong line is dropped as a whole
+        if (s.rxLength < FANOUT_RX_LINE_SIZE) {
+          s.rx[s.rxLength] = c;
+        }
+        if (s.rxLength < 255) {
+          s.rxLength++;
+        }
+        continue;
+      }
+      uint8_t length = s.rxLength;
+      s.rxLength = 0;
+      if (length <= FANOUT_RX_LINE_SIZE && parse(s.rx, length, msg)) {
+        *from = i;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool ControllerFanout::parse(const char* line, uint8_t length, MessageHelper& msg) {
+  uint32_t fields[5];
+  uint8_t pos = 0;
+  for (uint8_t i = 0; i < 5; i++) {
+    uint8_t used;
+    if (parseUInt32(line + pos, length - pos, &fields[i], &used) != PARSE_OK ||
+        pos + used >= length || line[pos + used] != ';') {
+      return false;
+    }
+    pos += used + 1;
+  }
+  if (fields[0] > 0xFFFF || fields[1] > 0xFF || fields[2] > C_ACK || fields[4] > 0xFF) {
+    return false;
+  }
+
+  Sensor_command command = (Sensor_command)fields[2];
+  msg.clearExtensions();
+  msg.setSensorAddress(fields[0]);
+  msg.setSensorID(fields[1]);
+  msg.setCommand(command);
+  switch (command) {
+    case C_PRESENTATION_CHILDREN:
+    case C_PRESENTATION_PARENT:
+      msg.setSensorType((Sensor_type)fields[4]);
+      break;
+    case C_SYSTEM:
+    case C_STREAM:
+      msg.setSystemMessageType((System_message_type)fields[4]);
+      break;
+    default:
+      msg.setSensorInformationType((Sensor_information_type)fields[4]);
+  }
+  uint8_t payloadLength = length - pos;
+  if (payloadLength >= msg.getPayloadSize()) {
+    payloadLength = msg.getPayloadSize() - 1;
+  }
+  memcpy(msg.getPayload(), line + pos, payloadLength);
+  msg.getPayload()[payloadLength] = '\0';
+  msg.setPayloadType(P_STRING);
+  return true;
+}
@@ -0,0 +1,92 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file ControllerFanout.h
+ *
+ * @brief Serves several controller links from the gateway loop
+ *
+ * Every controller link (Serial, an EthernetClient...) is a subscriber with a
+ * filter. A message is serialized once (MessageHelper::serialize()) and the same
+ * line is written to every matching subscriber. A subscriber that cannot take
+ * the whole line without blocking skips it and the drop is counted, so a slow
+ * link never stalls the gateway or the other links. Command lines received on
+ * the links are parsed back into Messages by poll().
+ */
+#ifndef CONTROLLERFANOUT_H
+#define CONTROLLERFANOUT_H
+
+#include <Arduino.h>
+#include "Message.h"
+
+#ifndef FANOUT_MAX_SUBSCRIBERS
+#define FANOUT_MAX_SUBSCRIBERS 4
+#endif
+/// @brief Longest line sent, a message that does not fit is counted by unserialized()
+#ifndef FANOUT_LINE_SIZE
+#define FANOUT_LINE_SIZE MESSAGE_LINE_SIZE
+#endif
+static_assert(FANOUT_LINE_SIZE <= MESSAGE_LINE_SIZE, "FANOUT_LINE_SIZE larger than the longest line");
+/// @brief Longest command line received
+#ifndef FANOUT_RX_LINE_SIZE
+#define FANOUT_RX_LINE_SIZE 64
+#endif
+
+#define FANOUT_ANY_ADDRESS 0xFFFF
+#define FANOUT_ANY_SENSOR 0xFF
+#define FANOUT_ALL_COMMANDS 0xFF
+
+/// @brief Messages a subscriber wants
+typedef struct {
+	uint8_t commands;		//!< Bit mask of Sensor_command (1 << C_SET...)
+	uint16_t address;		//!< Node address or FANOUT_ANY_ADDRESS
+	uint8_t sensorId;		//!< Child or FANOUT_ANY_SENSOR
+} Fanout_filter;
+
+
+class ControllerFanout {
+
+ public:
+	ControllerFanout();
+	/// @param checkSpace use availableForWrite() to detect a full link; leave it false
+	/// for links that do not implement it (a short write is then counted as a drop)
+	/// @return subscriber id, -1 if there is no room left
+	int8_t subscribe(Stream* link, const Fanout_filter& filter, bool checkSpace = true);
+	void unsubscribe(int8_t id);
+	void setFilter(int8_t id, const Fanout_filter& filter);
+	/// @brief Sends msg to every matching subscriber
+	/// @return number of subscribers that got it
+	uint8_t publish(const MessageHelper& msg);
+	/// @brief Reads the links, fills @p msg with the next complete command line
+	/// @param from subscriber the command comes from
+	bool poll(MessageHelper& msg, int8_t* from);
+	/// @brief Lines dropped for a subscriber because its link was full
+	uint16_t dropped(int8_t id) const;
+	/// @brief Messages sent to nobody because their line is longer than FANOUT_LINE_SIZE
+	uint16_t unserialized() const;
+
+	/// @brief Parses a serial protocol line, the payload is stored as P_STRING
+	static bool parse(const char* line, uint8_t length, MessageHelper& msg);
+
+ private:
+	typedef struct {
+		Stream* link;
+		Fanout_filter filter;
+		bool checkSpace;
+		uint16_t dropped;
+		uint8_t rxLength;
+		char rx[FANOUT_RX_LINE_SIZE];
+	} Subscriber;
+
+	bool matches(const Fanout_filter& filter, const MessageHelper& msg) const;
+
+	Subscriber subscribers_[FANOUT_MAX_SUBSCRIBERS];
+	uint8_t next_;
+	uint16_t unserialized_;
+	char line_[FANOUT_LINE_SIZE];
+};
+
+#endif
@@ -0,0 +1,227 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+
+#include "EepromStore.h"
+#include "MessageHash.h"
+
+#define EESTORE_MAGIC 0x4B // 'K'
+#define EESTORE_ERASED 0xFF
+
+//Constructor
+EepromStore::EepromStore(uint16_t base, uint16_t size) {
+  base_ = base;
+  // An undersized area could not take a compaction, it is not used at all
+  bankSize_ = size >= EESTORE_MIN_SIZE ? size / 2 : 0;
+  head_ = 0;
+  generation_ = 0;
+  bank_ = 0;
+  bytesWritten_ = 0;
+  compactions_ = 0;
+  for (uint8_t i = 0; i < EESTORE_MAX_KEYS; i++) {
+    entries_[i].used = false;
+  }
+}
+
+uint16_t EepromStore::bankStart(uint8_t bank) const {
+  return base_ + bank * bankSize_;
+}
+
+// Header: magic, generation (little endian), low byte of the generation hash
+bool EepromStore::readHeader(uint8_t bank, uint16_t* generation) const {
+  uint16_t address = bankStart(bank);
+  if (EEPROM.read(address) != EESTORE_MAGIC) {
+    return false;
+  }
+  *generation = EEPROM.read(address + 1) | (EEPROM.read(address + 2) << 8);
+  return EEPROM.read(address + 3) == (uint8_t)messageHash(generation, sizeof(uint16_t));
+}
+
+uint16_t EepromStore::recordCheck(uint8_t key, uint8_t length, const uint8_t* value) const {
+  uint8_t head[4] = { (uint8_t)generation_, (uint8_t)(generation_ >> 8), key, length };
+  return (uint16_t)messageHash(value, length, messageHash(head, sizeof(head)));
+}
+
+void EepromStore::writeByte(uint16_t address, uint8_t value) {
+  if (EEPROM.read(address) != value) {
+    EEPROM.write(address, value);
+    bytesWritten_++;
+  }
+}
+
+uint16_t EepromStore::writeRecord(uint16_t address, const Entry& entry) {
+  uint16_t check = recordCheck(entry.key, entry.length, entry.value);
+  writeByte(address++, entry.key);
+  writeByte(address++, entry.length);
+  for (uint8_t i = 0; i < entry.length; i++) {
+    writeByte(address++, entry.value[i]);
+  }
+  writeByte(address++, (uint8_t)check);
+  writeByte(address++, (uint8_t)(check >> 8));
+  return address;
+}
+
+bool EepromStore::begin() {
+  if (bankSize_ == 0) {
+    return false;
+  }
+  uint16_t generations[2];
+  bool valid[2] = { readHeader(0, &generations[0]), readHeader(1, &generations[1]) };
+  if (!valid[0] && !valid[1]) {
+    // Blank area: start a first generation
+    bank_ = 1;
+    generation_ = 0;
+    compact();
+    compactions_ = 0;
+    return true;
+  }
+  bank_ = valid[1] && (!valid[0] || (int16_t)(generations[1] - generations[0]) > 0) ? 1 : 0;
+  generation_ = generations[bank_];
+
+  // Replay the log, the last record of a key wins
+  uint16_t address = bankStart(bank_) + EESTORE_HEADER_SIZE;
+  uint16_t end = bankStart(bank_) + bankSize_;
+  while (address + EESTORE_RECORD_OVERHEAD <= end) {
+    Entry record;
+    record.key = EEPROM.read(address);
+    record.length = EEPROM.read(address + 1);
+    if (record.key == EESTORE_ERASED || record.length > EESTORE_MAX_VALUE ||
+        address + EESTORE_RECORD_OVERHEAD + record.length > end) {
+      break;
+    }
+    for (uint8_t i = 0; i < record.length; i++) {
+      record.value[i] = EEPROM.read(address + 2 + i);
+    }
+    uint16_t stored = EEPROM.read(address + 2 + record.length) |
+                      (EEPROM.read(address + 3 + record.length) << 8);
+    if (stored != recordCheck(record.key, record.length, record.value)) {
+      break;
+    }
+    set(record.key, record.value, record.length);
+    address += EESTORE_RECORD_OVERHEAD + record.length;
+  }
+  head_ = address;
+  for (uint8_t i = 0; i < EESTORE_MAX_KEYS; i++) {
+    entries_[i].dirty = false;
+  }
+  return true;
+}
+
+bool EepromStore::set(uint8_t key, const void* value, uint8_t length) {
+  if (key == EESTORE_ERASED || length > EESTORE_MAX_VALUE || bankSize_ == 0) {
+    return false;
+  }
+  Entry* entry = NULL;
+  for (uint8_t i = 0; i < EESTORE_MAX_KEYS && entry == NULL; i++) {
+    if (entries_[i].used && entries_[i].key == key) {
+      entry = &entries_[i];
+    }
+  }
+  if (entry == NULL) {
+    for (uint8_t i = 0; i < EESTORE_MAX_KEYS && entry == NULL; i++) {
+      if (!entries_[i].used) {
+        entry = &entries_[i];
+        entry->used = true;
+        entry->key = key;
+        entry->length = 0xFF;
+      }
+    }
+    if (entry == NULL) {
+      return false;
+    }
+  }
+  if (entry->length == length && memcmp(entry->value, value, length) == 0) {
+    return true;
+  }
+  entry->length = length;
+  memcpy(entry->value, value, length);
+  entry->dirty = true;
+  return true;
+}
+
+uint8_t EepromStore::get(uint8_t key, void* value, uint8_t size) const {
+  for (uint8_t i = 0; i < EESTORE_MAX_KEYS; i++) {
+    const Entry& entry = entries_[i];
+    if (entry.used && entry.key == key) {
+      memcpy(value, entry.value, entry.length < size ? entry.length : size);
+      return entry.length;
+    }
+  }
+  return 0;
+}
+
+uint8_t EepromStore::pending() const {
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < EESTORE_MAX_KEYS; i++) {
+    if (entries_[i].used && entries_[i].dirty) {
+      n++;
+    }
+  }
+  return n;
+}
+
+// Writes every value into the other half, then its header with the next generation.
+// Returns false, the current half untouched, if the values do not fit in a half.
+bool EepromStore::compact() {
+  uint16_t needed = EESTORE_HEADER_SIZE;
+  for (uint8_t i = 0; i < EESTORE_MAX_KEYS; i++) {
+    if (entries_[i].used) {
+      needed += EESTORE_RECORD_OVERHEAD + entries_[i].length;
+    }
+  }
+  if (needed > bankSize_) {
+    return false;
+  }
+
+  uint8_t target = bank_ ^ 1;
+  generation_++;
+  uint16_t address = bankStart(target) + EESTORE_HEADER_SIZE;
+  for (uint8_t i = 0; i < EESTORE_MAX_KEYS; i++) {
+    if (entries_[i].used) {
+      address = writeRecord(address, entries_[i]);
+      entries_[i].dirty = false;
+    }
+  }
+  uint16_t header = bankStart(target);
+  writeByte(header + 1, (uint8_t)generation_);
+  writeByte(header + 2, (uint8_t)(generation_ >> 8));
+  writeByte(header + 3, (uint8_t)messageHash(&generation_, sizeof(uint16_t)));
+  writeByte(header, EESTORE_MAGIC);
+  bank_ = target;
+  head_ = address;
+  compactions_++;
+  return true;
+}
+
+uint8_t EepromStore::flush() {
+  uint8_t written = 0;
+  uint16_t end = bankStart(bank_) + bankSize_;
+  if (bankSize_ == 0) {
+    return 0;
+  }
+  for (uint8_t i = 0; i < EESTORE_MAX_KEYS; i++) {
+    Entry& entry = entries_[i];
+    if (!entry.used || !entry.dirty) {
+      continue;
+    }
+    if (head_ + EESTORE_RECORD_OVERHEAD + entry.length > end) {
+      // Compaction writes all the values, the pending ones included
+      return compact() ? written + 1 : written;
+    }
+    head_ = writeRecord(head_, entry);
+    entry.dirty = false;
+    written++;
+  }
+  return written;
+}
+
+uint32_t EepromStore::bytesWritten() const {
+  return bytesWritten_;
+}
+
+uint16_t EepromStore::compactions() const {
+  return compactions_;
+}
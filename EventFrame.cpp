@@ -0,0 +1,61 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+
+#include "EventFrame.h"
+
+static const Sensor_information_type eventTypes[] = { V_TRIPPED, V_ARMED, V_STATUS, V_LOCK_STATUS };
+
+bool eventFromMessage(const MessageHelper& msg, uint8_t* event) {
+  if (msg.getCommand() != C_SET || msg.getSensorID() > EVENT_MAX_CHILD || msg.hasExtensions()) {
+    return false;
+  }
+  uint8_t kind = 0;
+  while (kind < 4 && eventTypes[kind] != msg.getSensorInformationType()) kind++;
+  if (kind == 4) {
+    return false;
+  }
+  const char* payload = msg.getPayload();
+  bool value;
+  switch (msg.getPayloadType()) {
+    case P_BOOL:
+    case P_UCHAR:
+    case P_BYNARY_BYTE:
+      value = payload[0] != 0;
+      break;
+    case P_STRING:
+      // "0" or "1", as sent by the serial controllers
+      if ((payload[0] != '0' && payload[0] != '1') || payload[1] != '\0') {
+        return false;
+      }
+      value = payload[0] == '1';
+      break;
+    default:
+      return false;
+  }
+  *event = eventEncode(msg.getSensorID(), (Event_kind)kind, value);
+  return true;
+}
+
+void eventToMessage(uint8_t event, uint16_t address, MessageHelper& msg) {
+  msg.clearExtensions();
+  msg.setSensorAddress(address);
+  msg.setSensorID(eventChild(event));
+  msg.setCommand(C_SET);
+  msg.setSensorInformationType(eventTypes[eventKind(event)]);
+  msg.setPayloadType(P_BOOL);
+  memset(msg.getPayload(), 0, msg.getPayloadSize());
+  msg.getPayload()[0] = eventValue(event);
+}
+
+bool sendEvent(RF24Network& network, uint16_t to, uint8_t child, Event_kind kind, bool value) {
+  if (child > EVENT_MAX_CHILD) {
+    return false;
+  }
+  uint8_t event = eventEncode(child, kind, value);
+  RF24NetworkHeader header(to, EVENT_HEADER_TYPE);
+  return network.write(header, &event, 1);
+}
@@ -0,0 +1,72 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file EventFrame.h
+ *
+ * @brief One byte frames for the binary state changes
+ *
+ * A change of V_TRIPPED, V_ARMED, V_STATUS or V_LOCK_STATUS is sent as a
+ * single byte in a frame of RF24NetworkHeader type EVENT_HEADER_TYPE, the
+ * address of the node being the one of the network header:
+ *
+ *     bits 7..3 child id (0 to 31), bits 2..1 Event_kind, bit 0 value
+ *
+ * The gateway gives these frames to an EventHandler as soon as they are read
+ * (see RF24NetworkTransport::setEventHandler()), without building a Message.
+ * EVENT_HEADER_TYPE is a user type from 1 to 64, for which RF24Network sends
+ * no network ACK (types 65 to 127 get one), and it differs from the header
+ * type of the messages (0 by default).
+ */
+#ifndef EVENTFRAME_H
+#define EVENTFRAME_H
+
+#include <Arduino.h>
+#include "RF24Network.h"
+#include "Message.h"
+
+/// @brief RF24NetworkHeader type of the event frames
+#ifndef EVENT_HEADER_TYPE
+#define EVENT_HEADER_TYPE 5
+#endif
+#if EVENT_HEADER_TYPE < 1 || EVENT_HEADER_TYPE > 64
+#error "EVENT_HEADER_TYPE must be from 1 to 64, RF24Network ACKs the other user types"
+#endif
+#define EVENT_MAX_CHILD 31
+
+/// @brief Value carried by an event frame
+typedef enum : unsigned char {
+	EV_TRIPPED				= 0,	//!< V_TRIPPED
+	EV_ARMED				= 1,	//!< V_ARMED
+	EV_STATUS				= 2,	//!< V_STATUS
+	EV_LOCK_STATUS			= 3		//!< V_LOCK_STATUS
+} Event_kind;
+
+/// @brief Called by the gateway for every event frame received
+typedef void (*EventHandler)(uint16_t address, uint8_t child, Event_kind kind, bool value);
+
+inline uint8_t eventEncode(uint8_t child, Event_kind kind, bool value) {
+	return (child << 3) | (kind << 1) | (value ? 1 : 0);
+}
+inline uint8_t eventChild(uint8_t event) {
+	return event >> 3;
+}
+inline Event_kind eventKind(uint8_t event) {
+	return (Event_kind)((event >> 1) & 3);
+}
+inline bool eventValue(uint8_t event) {
+	return event & 1;
+}
+
+/// @brief Encodes a C_SET of a binary value as an event
+/// @return false if the message does not fit an event frame
+bool eventFromMessage(const MessageHelper& msg, uint8_t* event);
+/// @brief Rebuilds the C_SET (P_BOOL) carried by an event
+void eventToMessage(uint8_t event, uint16_t address, MessageHelper& msg);
+/// @brief Sends an event frame to @p to (the gateway is 0)
+bool sendEvent(RF24Network& network, uint16_t to, uint8_t child, Event_kind kind, bool value);
+
+#endif
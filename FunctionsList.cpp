@@ -0,0 +1,255 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+
+#include "FunctionsList.h"
+
+static void putHeader(uint8_t* payload, uint32_t hash, uint16_t value) {
+  payload[0] = (uint8_t)hash;
+  payload[1] = (uint8_t)(hash >> 8);
+  payload[2] = (uint8_t)(hash >> 16);
+  payload[3] = (uint8_t)(hash >> 24);
+  payload[4] = (uint8_t)value;
+  payload[5] = (uint8_t)(value >> 8);
+}
+
+static uint32_t getHeaderHash(const uint8_t* payload) {
+  return (uint32_t)payload[0] | ((uint32_t)payload[1] << 8) |
+         ((uint32_t)payload[2] << 16) | ((uint32_t)payload[3] << 24);
+}
+
+static uint16_t getHeaderValue(const uint8_t* payload) {
+  return payload[4] | (payload[5] << 8);
+}
+
+
+//Constructor
+FunctionsListSender::FunctionsListSender(const uint8_t* list, uint16_t length) {
+  list_ = list;
+  length_ = length;
+  offset_ = length;
+  hash_ = messageHash(list, length);
+  progmem_ = false;
+}
+
+FunctionsListSender::FunctionsListSender(const uint8_t* progmemList, uint16_t length, uint32_t hash) {
+  list_ = progmemList;
+  length_ = length;
+  offset_ = length;
+  hash_ = hash;
+  progmem_ = true;
+}
+
+uint32_t FunctionsListSender::getHash() const {
+  return hash_;
+}
+
+void FunctionsListSender::announce(MessageHelper& msg) const {
+  msg.setCommand(C_SYSTEM);
+  msg.setSystemMessageType(I_SPECIAL_FUNCTIONSLIST);
+  msg.setPayloadType(P_BYNARY_BYTE);
+  putHeader((uint8_t*)msg.getPayload(), hash_, length_);
+}
+
+bool FunctionsListSender::onRequest(const MessageHelper& msg) {
+  if (msg.getCommand() != C_REQ || msg.getSystemMessageType() != I_SPECIAL_FUNCTIONSLIST) {
+    return false;
+  }
+  const uint8_t* payload = (const uint8_t*)msg.getPayload();
+  if (getHeaderHash(payload) != hash_) {
+    return false;
+  }
+  uint16_t offset = getHeaderValue(payload);
+  offset_ = offset < length_ ? offset : length_;
+  return true;
+}
+
+bool FunctionsListSender::next(MessageHelper& msg) {
+  if (offset_ >= length_) {
+    return false;
+  }
+  uint16_t left = length_ - offset_;
+  // Chunks carry their offset, a message with extensions just takes fewer bytes
+  uint8_t room = msg.getPayloadSize() - FUNCTIONS_CHUNK_HEADER_SIZE;
+  uint8_t count = left < room ? left : room;
+
+  msg.setCommand(C_STREAM);
+  msg.setStreamType(ST_FUNCTIONSLIST);
+  msg.setPayloadType(P_BYNARY_BYTE);
+  uint8_t* payload = (uint8_t*)msg.getPayload();
+  putHeader(payload, hash_, offset_);
+  payload[6] = count;
+  if (progmem_) {
+    memcpy_P(payload + FUNCTIONS_CHUNK_HEADER_SIZE, list_ + offset_, count);
+  } else {
+    memcpy(payload + FUNCTIONS_CHUNK_HEADER_SIZE, list_ + offset_, count);
+  }
+  offset_ += count;
+  return true;
+}
+
+
+//Constructor
+FunctionsListCache::FunctionsListCache() {
+  for (uint8_t i = 0; i < FUNCTIONS_CACHE_ENTRIES; i++) {
+    entries_[i].refs = 0;
+    entries_[i].length = 0;
+    entries_[i].filled = 0;
+    entries_[i].complete = false;
+  }
+  for (uint8_t i = 0; i < FUNCTIONS_CACHE_NODES; i++) {
+    nodes_[i].used = false;
+  }
+}
+
+int8_t FunctionsListCache::findEntry(uint32_t hash) const {
+  for (uint8_t i = 0; i < FUNCTIONS_CACHE_ENTRIES; i++) {
+    if ((entries_[i].refs || entries_[i].complete) && entries_[i].hash == hash) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Takes an entry no node refers to, preferring one that holds no complete list
+int8_t FunctionsListCache::allocEntry(uint32_t hash, uint16_t length) {
+  int8_t found = -1;
+  for (uint8_t i = 0; i < FUNCTIONS_CACHE_ENTRIES; i++) {
+    if (entries_[i].refs == 0) {
+      found = i;
+      if (!entries_[i].complete) {
+        break;
+      }
+    }
+  }
+  if (found >= 0) {
+    Entry& entry = entries_[found];
+    entry.hash = hash;
+    entry.length = length;
+    entry.filled = 0;
+    entry.complete = length == 0;
+  }
+  return found;
+}
+
+int8_t FunctionsListCache::findNode(uint16_t address) const {
+  for (uint8_t i = 0; i < FUNCTIONS_CACHE_NODES; i++) {
+    if (nodes_[i].used && nodes_[i].address == address) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void FunctionsListCache::buildRequest(const Entry& entry, uint16_t address, MessageHelper& request) const {
+  request.setSensorAddress(address);
+  request.setCommand(C_REQ);
+  request.setSystemMessageType(I_SPECIAL_FUNCTIONSLIST);
+  request.setPayloadType(P_BYNARY_BYTE);
+  putHeader((uint8_t*)request.getPayload(), entry.hash, entry.filled);
+}
+
+bool FunctionsListCache::onAnnounce(const MessageHelper& msg, MessageHelper& request) {
+  if (msg.getCommand() != C_SYSTEM || msg.getSystemMessageType() != I_SPECIAL_FUNCTIONSLIST) {
+    return false;
+  }
+  const uint8_t* payload = (const uint8_t*)msg.getPayload();
+  uint32_t hash = getHeaderHash(payload);
+  uint16_t length = getHeaderValue(payload);
+  uint16_t address = msg.getSensorAddress();
+
+  int8_t node = findNode(address);
+  if (node < 0) {
+    for (uint8_t i = 0; i < FUNCTIONS_CACHE_NODES && node < 0; i++) {
+      if (!nodes_[i].used) {
+        node = i;
+      }
+    }
+    if (node < 0) {
+      return false;
+    }
+    nodes_[node].used = true;
+    nodes_[node].address = address;
+  } else {
+    Entry& previous = entries_[nodes_[node].entry];
+    if (previous.hash == hash) {
+      // Same list as before, only ask again if the transfer did not finish
+      if (previous.complete) {
+        return false;
+      }
+      buildRequest(previous, address, request);
+      return true;
+    }
+    previous.refs--;
+  }
+
+  int8_t entry = findEntry(hash);
+  if (entry < 0) {
+    entry = length <= FUNCTIONS_LIST_MAX_SIZE ? allocEntry(hash, length) : -1;
+    if (entry < 0) {
+      nodes_[node].used = false;
+      return false;
+    }
+  }
+  nodes_[node].entry = entry;
+  entries_[entry].refs++;
+  if (entries_[entry].complete) {
+    return false;
+  }
+  buildRequest(entries_[entry], address, request);
+  return true;
+}
+
+Functions_chunk_result FunctionsListCache::onChunk(const MessageHelper& msg, MessageHelper& request) {
+  if (msg.getCommand() != C_STREAM || msg.getStreamType() != ST_FUNCTIONSLIST) {
+    return FL_IGNORED;
+  }
+  const uint8_t* payload = (const uint8_t*)msg.getPayload();
+  int8_t index = findEntry(getHeaderHash(payload));
+  if (index < 0) {
+    return FL_IGNORED;
+  }
+  Entry& entry = entries_[index];
+  uint16_t offset = getHeaderValue(payload);
+  uint8_t count = payload[6];
+  // Chunks are stored in order, a gap is filled by the next request
+  if (entry.complete || offset != entry.filled || count > msg.getPayloadSize() - FUNCTIONS_CHUNK_HEADER_SIZE ||
+      offset + count > entry.length) {
+    return FL_IGNORED;
+  }
+  memcpy(entry.data + offset, payload + FUNCTIONS_CHUNK_HEADER_SIZE, count);
+  entry.filled += count;
+  if (entry.filled < entry.length) {
+    return FL_PARTIAL;
+  }
+  if (messageHash(entry.data, entry.length) != entry.hash) {
+    entry.filled = 0;
+    buildRequest(entry, msg.getSensorAddress(), request);
+    return FL_CORRUPT;
+  }
+  entry.complete = true;
+  return FL_COMPLETE;
+}
+
+bool FunctionsListCache::lookup(uint16_t address, const uint8_t** list, uint16_t* length) const {
+  int8_t node = findNode(address);
+  if (node < 0 || !entries_[nodes_[node].entry].complete) {
+    return false;
+  }
+  const Entry& entry = entries_[nodes_[node].entry];
+  *list = entry.data;
+  *length = entry.length;
+  return true;
+}
+
+bool FunctionsListCache::getHash(uint16_t address, uint32_t* hash) const {
+  int8_t node = findNode(address);
+  if (node < 0) {
+    return false;
+  }
+  *hash = entries_[nodes_[node].entry].hash;
+  return true;
+}
@@ -0,0 +1,119 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file FunctionsList.h
+ *
+ * @brief Versioned transfer of the node functions list (ST_FUNCTIONSLIST)
+ *
+ * A node announces the hash and the size of its functions list with a short
+ * C_SYSTEM / I_SPECIAL_FUNCTIONSLIST message. The gateway keeps the lists in a
+ * cache addressed by their hash, so identical nodes share one entry, and sends
+ * back a C_REQ / I_SPECIAL_FUNCTIONSLIST only when the hash is not known. The
+ * node then streams the list in C_STREAM / ST_FUNCTIONSLIST chunks.
+ *
+ * Announce and request payload: hash (4 bytes), size or offset (2 bytes).
+ * Chunk payload: hash (4 bytes), offset (2 bytes), count (1 byte), data.
+ */
+#ifndef FUNCTIONSLIST_H
+#define FUNCTIONSLIST_H
+
+#include <Arduino.h>
+#include "Message.h"
+#include "MessageHash.h"
+
+#define FUNCTIONS_CHUNK_HEADER_SIZE 7
+#define FUNCTIONS_CHUNK_DATA_SIZE (MESSAGE_PAYLOAD_SIZE - FUNCTIONS_CHUNK_HEADER_SIZE)
+
+/// @brief Biggest functions list the gateway can cache
+#ifndef FUNCTIONS_LIST_MAX_SIZE
+#define FUNCTIONS_LIST_MAX_SIZE 128
+#endif
+/// @brief Number of different lists the gateway can cache
+#ifndef FUNCTIONS_CACHE_ENTRIES
+#define FUNCTIONS_CACHE_ENTRIES 4
+#endif
+/// @brief Number of nodes the gateway keeps track of
+#ifndef FUNCTIONS_CACHE_NODES
+#define FUNCTIONS_CACHE_NODES 16
+#endif
+
+/// @brief Result of FunctionsListCache::onChunk()
+typedef enum : unsigned char {
+	FL_IGNORED				= 0,	//!< Not a chunk of a list being received
+	FL_PARTIAL				= 1,	//!< Chunk stored, more are expected
+	FL_COMPLETE				= 2,	//!< The list is complete and matches its hash
+	FL_CORRUPT				= 3		//!< The list does not match its hash and has been dropped, send the request again
+} Functions_chunk_result;
+
+
+class FunctionsListSender {
+
+ public:
+	FunctionsListSender(const uint8_t* list, uint16_t length);
+	/// @brief Sends a list stored in PROGMEM, with its hash computed at compile time (see NodeDescriptor.h)
+	FunctionsListSender(const uint8_t* progmemList, uint16_t length, uint32_t hash);
+	uint32_t getHash() const;
+	/// @brief Builds the I_SPECIAL_FUNCTIONSLIST announce
+	void announce(MessageHelper& msg) const;
+	/// @brief Handles a C_REQ / I_SPECIAL_FUNCTIONSLIST from the gateway
+	/// @return true if the request is for this list, the chunks are then available with next()
+	bool onRequest(const MessageHelper& msg);
+	/// @brief Fills @p msg with the next requested chunk
+	/// @return false when there is nothing left to send
+	bool next(MessageHelper& msg);
+
+ private:
+	const uint8_t* list_;
+	uint16_t length_;
+	uint16_t offset_;
+	uint32_t hash_;
+	bool progmem_;
+};
+
+
+class FunctionsListCache {
+
+ public:
+	FunctionsListCache();
+	/// @brief Handles the announce of a node
+	/// @return true on a cache miss, @p request is then the C_REQ to send to the node
+	bool onAnnounce(const MessageHelper& msg, MessageHelper& request);
+	/// @brief Stores a ST_FUNCTIONSLIST chunk
+	/// @param request on FL_CORRUPT, the C_REQ asking the node for the whole list again
+	Functions_chunk_result onChunk(const MessageHelper& msg, MessageHelper& request);
+	/// @brief Gives the functions list of a node
+	/// @return false if the node list is unknown or not complete yet
+	bool lookup(uint16_t address, const uint8_t** list, uint16_t* length) const;
+	/// @brief Gives the hash announced by a node
+	bool getHash(uint16_t address, uint32_t* hash) const;
+
+ private:
+	typedef struct {
+		uint32_t hash;
+		uint16_t length;
+		uint16_t filled;
+		uint8_t refs;
+		bool complete;
+		uint8_t data[FUNCTIONS_LIST_MAX_SIZE];
+	} Entry;
+
+	typedef struct {
+		uint16_t address;
+		uint8_t entry;
+		bool used;
+	} NodeSlot;
+
+	int8_t findEntry(uint32_t hash) const;
+	int8_t allocEntry(uint32_t hash, uint16_t length);
+	int8_t findNode(uint16_t address) const;
+	void buildRequest(const Entry& entry, uint16_t address, MessageHelper& request) const;
+
+	Entry entries_[FUNCTIONS_CACHE_ENTRIES];
+	NodeSlot nodes_[FUNCTIONS_CACHE_NODES];
+};
+
+#endif
@@ -0,0 +1,177 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+
+#include "HeaderCompressor.h"
+
+// Offset of the 7 header fields in Message, the address is the only 2 byte field
+static const uint8_t fieldOffset[] = { 0, 1, 3, 4, 5, 6, 7, HC_HEADER_SIZE };
+
+static_assert(offsetof(Message, payload) == HC_HEADER_SIZE, "HeaderCompressor expects the Message layout");
+
+//Constructor
+HeaderCompressor::HeaderCompressor() : clock_(0), evicted_(0), hasEvicted_(false) {
+  for (uint8_t i = 0; i < HEADER_COMPRESSOR_LINKS; i++) {
+    links_[i].used = false;
+  }
+}
+
+HeaderCompressor::Link* HeaderCompressor::find(uint16_t peer) {
+  for (uint8_t i = 0; i < HEADER_COMPRESSOR_LINKS; i++) {
+    if (links_[i].used && links_[i].peer == peer) {
+      return &links_[i];
+    }
+  }
+  return NULL;
+}
+
+// Finds the link, or takes over a free one or the least recently used one
+HeaderCompressor::Link* HeaderCompressor::link(uint16_t peer) {
+  clock_++;
+  Link* l = find(peer);
+  if (l == NULL) {
+    l = &links_[0];
+    for (uint8_t i = 0; i < HEADER_COMPRESSOR_LINKS && l->used; i++) {
+      if (!links_[i].used || (uint16_t)(clock_ - links_[i].lastUse) > (uint16_t)(clock_ - l->lastUse)) {
+        l = &links_[i];
+      }
+    }
+    if (l->used && l->rxValid) {
+      // The peer still sends against the context dropped here
+      evicted_ = l->peer;
+      hasEvicted_ = true;
+    }
+    memset(l, 0, sizeof(Link));
+    l->used = true;
+    l->peer = peer;
+  }
+  l->lastUse = clock_;
+  return l;
+}
+
+bool HeaderCompressor::takeEvicted(uint16_t* peer) {
+  if (!hasEvicted_) {
+    return false;
+  }
+  hasEvicted_ = false;
+  *peer = evicted_;
+  return true;
+}
+
+void HeaderCompressor::reset(uint16_t peer) {
+  Link* l = find(peer);
+  if (l) {
+    l->txValid = false;
+    l->rxValid = false;
+  }
+}
+
+uint8_t HeaderCompressor::compress(const MessageHelper& msg, uint16_t peer, uint8_t* frame, uint8_t size) {
+  Link* l = link(peer);
+  const uint8_t* header = (const uint8_t*)&msg.internalMessage_;
+
+  uint8_t changed = 0;
+  uint8_t count = 0;
+  for (uint8_t f = 0; f < 7; f++) {
+    if (memcmp(header + fieldOffset[f], l->tx + fieldOffset[f], fieldOffset[f + 1] - fieldOffset[f]) != 0) {
+      changed |= 1 << f;
+      count++;
+    }
+  }
+  if (!l->txValid || count >= HEADER_COMPRESSOR_RECONTEXT || l->txCount >= HEADER_COMPRESSOR_REFRESH) {
+    changed = HC_CONTEXT | HC_ALL_FIELDS;
+  }
+
+  uint8_t payloadLength = MESSAGE_PAYLOAD_SIZE;
+  while (payloadLength && msg.internalMessage_.payload[payloadLength - 1] == 0) payloadLength--;
+
+  uint8_t length = 2;
+  for (uint8_t f = 0; f < 7; f++) {
+    if (changed & (1 << f)) {
+      length += fieldOffset[f + 1] - fieldOffset[f];
+    }
+  }
+  if (length + payloadLength > size) {
+    return 0;
+  }
+
+  if (changed & HC_CONTEXT) {
+    memcpy(l->tx, header, HC_HEADER_SIZE);
+    l->txId++;
+    l->txValid = true;
+    l->txCount = 0;
+  } else {
+    l->txCount++;
+  }
+  frame[0] = changed;
+  frame[1] = l->txId;
+  uint8_t pos = 2;
+  for (uint8_t f = 0; f < 7; f++) {
+    if (changed & (1 << f)) {
+      uint8_t width = fieldOffset[f + 1] - fieldOffset[f];
+      memcpy(frame + pos, header + fieldOffset[f], width);
+      pos += width;
+    }
+  }
+  memcpy(frame + pos, msg.internalMessage_.payload, payloadLength);
+  return pos + payloadLength;
+}
+
+Header_result HeaderCompressor::decompress(const uint8_t* frame, uint8_t length, uint16_t peer, MessageHelper& msg) {
+  if (length < 2) {
+    return HC_MALFORMED;
+  }
+  Link* l = link(peer);
+  uint8_t changed = frame[0];
+
+  if (changed == HC_CONTEXT) {
+    l->txValid = false;
+    return HC_RESYNC_REQUESTED;
+  }
+  if (changed & HC_CONTEXT) {
+    if (changed != (HC_CONTEXT | HC_ALL_FIELDS) || length < 2 + HC_HEADER_SIZE) {
+      return HC_MALFORMED;
+    }
+    memcpy(l->rx, frame + 2, HC_HEADER_SIZE);
+    l->rxId = frame[1];
+    l->rxValid = true;
+  } else if (!l->rxValid || l->rxId != frame[1]) {
+    l->rxValid = false;
+    return HC_RESYNC;
+  }
+
+  uint8_t* header = (uint8_t*)&msg.internalMessage_;
+  memcpy(header, l->rx, HC_HEADER_SIZE);
+  uint8_t pos = 2;
+  for (uint8_t f = 0; f < 7; f++) {
+    if (changed & (1 << f)) {
+      uint8_t width = fieldOffset[f + 1] - fieldOffset[f];
+      if (pos + width > length) {
+        return HC_MALFORMED;
+      }
+      memcpy(header + fieldOffset[f], frame + pos, width);
+      pos += width;
+    }
+  }
+  uint8_t payloadLength = length - pos;
+  if (payloadLength > MESSAGE_PAYLOAD_SIZE) {
+    return HC_MALFORMED;
+  }
+  memcpy(msg.internalMessage_.payload, frame + pos, payloadLength);
+  memset(msg.internalMessage_.payload + payloadLength, 0, MESSAGE_PAYLOAD_SIZE - payloadLength);
+  return HC_OK;
+}
+
+// Does not take a link, the peer may have just been evicted
+uint8_t HeaderCompressor::resyncRequest(uint16_t peer, uint8_t* frame) {
+  Link* l = find(peer);
+  if (l) {
+    l->rxValid = false;
+  }
+  frame[0] = HC_CONTEXT;
+  frame[1] = l ? l->rxId : 0;
+  return 2;
+}
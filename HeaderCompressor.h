@@ -0,0 +1,109 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file HeaderCompressor.h
+ *
+ * @brief Per link compression of the Message header
+ *
+ * Both ends of a link keep a context: the last header sent in full on that
+ * link, numbered by a context id. A compressed frame is:
+ *
+ *     flags, context id, the changed header fields, the payload
+ *
+ * The low 7 bits of flags tell which of the 7 header fields (sensor id,
+ * address, command, sensor type, information type, system message type,
+ * datatype) differ from the context, only those are sent. With HC_CONTEXT set
+ * all the fields are sent and the header becomes the new context. The payload
+ * is sent without its trailing zero bytes. A header repeated on the link
+ * shrinks from 8 bytes to 2.
+ *
+ * The context only changes with full headers, so losing a compressed frame
+ * does not desynchronise the link. A frame naming a context id the receiver
+ * does not hold is dropped (HC_RESYNC) and the receiver sends a resync request
+ * (resyncRequest()), the sender answers with a full header.
+ *
+ * When all the contexts are taken, the least recently used link is dropped.
+ * takeEvicted() gives its peer, which is sent a resync request right away so
+ * its next frame carries a full header instead of being dropped.
+ */
+#ifndef HEADERCOMPRESSOR_H
+#define HEADERCOMPRESSOR_H
+
+#include <Arduino.h>
+#include "Message.h"
+
+/// @brief Number of links a context is kept for, a gateway talks to every known node
+/// so it should be at least REGISTRY_MAX_NODES there
+#ifndef HEADER_COMPRESSOR_LINKS
+#define HEADER_COMPRESSOR_LINKS 16
+#endif
+/// @brief A full header is sent at least every HEADER_COMPRESSOR_REFRESH frames of a link
+#ifndef HEADER_COMPRESSOR_REFRESH
+#define HEADER_COMPRESSOR_REFRESH 32
+#endif
+/// @brief Number of changed fields from which the header becomes the new context
+#ifndef HEADER_COMPRESSOR_RECONTEXT
+#define HEADER_COMPRESSOR_RECONTEXT 3
+#endif
+
+#define HC_CONTEXT 0x80
+#define HC_ALL_FIELDS 0x7F
+/// @brief Size of the header bytes of a Message (payload excluded)
+#define HC_HEADER_SIZE 8
+/// @brief Maximum size of a compressed frame
+#define HC_FRAME_SIZE (2 + HC_HEADER_SIZE + MESSAGE_PAYLOAD_SIZE)
+
+/// @brief Result of HeaderCompressor::decompress()
+typedef enum : unsigned char {
+	HC_OK					= 0,	//!< The message has been rebuilt
+	HC_RESYNC				= 1,	//!< Unknown context, send resyncRequest() to the peer
+	HC_RESYNC_REQUESTED		= 2,	//!< The peer asked for a full header, nothing to deliver
+	HC_MALFORMED			= 3		//!< Frame too short
+} Header_result;
+
+
+class HeaderCompressor {
+
+ public:
+	HeaderCompressor();
+	/// @brief Encodes @p msg for the link to @p peer
+	/// @return the length of the frame, 0 if size is too small
+	uint8_t compress(const MessageHelper& msg, uint16_t peer, uint8_t* frame, uint8_t size);
+	/// @brief Rebuilds the message from a frame received from @p peer
+	Header_result decompress(const uint8_t* frame, uint8_t length, uint16_t peer, MessageHelper& msg);
+	/// @brief Writes the 2 byte frame asking @p peer to send a full header
+	uint8_t resyncRequest(uint16_t peer, uint8_t* frame);
+	/// @brief Forgets the contexts of a link, both ends start again with a full header
+	void reset(uint16_t peer);
+	/// @brief Gives the peer whose link was dropped to make room, if it was sending
+	/// compressed frames; send it resyncRequest()
+	bool takeEvicted(uint16_t* peer);
+
+ private:
+	typedef struct {
+		uint16_t peer;
+		bool used;
+		bool txValid;
+		bool rxValid;
+		uint8_t txId;
+		uint8_t rxId;
+		uint8_t txCount;
+		uint16_t lastUse;
+		uint8_t tx[HC_HEADER_SIZE];
+		uint8_t rx[HC_HEADER_SIZE];
+	} Link;
+
+	Link* find(uint16_t peer);
+	Link* link(uint16_t peer);
+
+	Link links_[HEADER_COMPRESSOR_LINKS];
+	uint16_t clock_;
+	uint16_t evicted_;
+	bool hasEvicted_;
+};
+
+#endif
@@ -0,0 +1,193 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+
+#include "ImageStream.h"
+
+// Adam7: first pixel, step between pixels and size of the block a pixel stands for
+static const uint8_t passXStart[IMAGE_PASSES] PROGMEM = { 0, 4, 0, 2, 0, 1, 0 };
+static const uint8_t passYStart[IMAGE_PASSES] PROGMEM = { 0, 0, 4, 0, 2, 0, 1 };
+static const uint8_t passXStep[IMAGE_PASSES] PROGMEM = { 8, 8, 4, 4, 2, 2, 1 };
+static const uint8_t passYStep[IMAGE_PASSES] PROGMEM = { 8, 8, 8, 4, 4, 2, 2 };
+static const uint8_t passBlockWidth[IMAGE_PASSES] PROGMEM = { 8, 4, 4, 2, 2, 1, 1 };
+static const uint8_t passBlockHeight[IMAGE_PASSES] PROGMEM = { 8, 8, 4, 4, 2, 2, 1 };
+
+static uint16_t passSize(uint16_t size, uint8_t start, uint8_t step) {
+  return size > start ? (size - start + step - 1) / step : 0;
+}
+
+static uint16_t passWidth(uint8_t pass, uint16_t width) {
+  return passSize(width, pgm_read_byte(&passXStart[pass]), pgm_read_byte(&passXStep[pass]));
+}
+
+static uint16_t passHeight(uint8_t pass, uint16_t height) {
+  return passSize(height, pgm_read_byte(&passYStart[pass]), pgm_read_byte(&passYStep[pass]));
+}
+
+
+//Constructor
+ImageStreamSender::ImageStreamSender() {
+  reader_ = NULL;
+  pass_ = IMAGE_PASSES;
+}
+
+void ImageStreamSender::begin(uint8_t imageId, uint16_t width, uint16_t height, ImagePixelReader reader, void* context) {
+  reader_ = reader;
+  context_ = context;
+  width_ = width;
+  height_ = height;
+  imageId_ = imageId;
+  pass_ = 0;
+  offset_ = 0;
+}
+
+bool ImageStreamSender::next(MessageHelper& msg) {
+  if (reader_ == NULL) {
+    return false;
+  }
+  for (; pass_ < IMAGE_PASSES; pass_++, offset_ = 0) {
+    uint16_t pw = passWidth(pass_, width_);
+    uint32_t total = (uint32_t)pw * passHeight(pass_, height_);
+    uint32_t first = (uint32_t)offset_ * IMAGE_CHUNK_PIXELS;
+    if (first >= total) {
+      continue;
+    }
+    uint8_t count = total - first < IMAGE_CHUNK_PIXELS ? total - first : IMAGE_CHUNK_PIXELS;
+
+    // Chunks are numbered in IMAGE_CHUNK_PIXELS, they need the whole payload
+    msg.clearExtensions();
+    msg.setCommand(C_STREAM);
+    msg.setStreamType(ST_IMAGE);
+    msg.setPayloadType(P_BYNARY_BYTE);
+    uint8_t* payload = (uint8_t*)msg.getPayload();
+    payload[0] = imageId_;
+    payload[1] = pass_;
+    payload[2] = (uint8_t)width_;
+    payload[3] = (uint8_t)(width_ >> 8);
+    payload[4] = (uint8_t)height_;
+    payload[5] = (uint8_t)(height_ >> 8);
+    payload[6] = (uint8_t)offset_;
+    payload[7] = (uint8_t)(offset_ >> 8);
+    payload[8] = count;
+
+    uint8_t xStart = pgm_read_byte(&passXStart[pass_]);
+    uint8_t yStart = pgm_read_byte(&passYStart[pass_]);
+    uint8_t xStep = pgm_read_byte(&passXStep[pass_]);
+    uint8_t yStep = pgm_read_byte(&passYStep[pass_]);
+    for (uint8_t i = 0; i < count; i++) {
+      uint32_t index = first + i;
+      uint16_t x = xStart + (index % pw) * xStep;
+      uint16_t y = yStart + (index / pw) * yStep;
+      payload[IMAGE_CHUNK_HEADER_SIZE + i] = reader_(x, y, context_);
+    }
+    offset_++;
+    return true;
+  }
+  return false;
+}
+
+
+//Constructor
+ImageStreamReceiver::ImageStreamReceiver(uint8_t* frame, uint8_t* levels, uint32_t maxPixels) {
+  frame_ = frame;
+  levels_ = levels;
+  maxPixels_ = maxPixels;
+  received_ = 0;
+  width_ = 0;
+  height_ = 0;
+  imageId_ = 0;
+  started_ = false;
+}
+
+// Levels are 4 bit: 0 when nothing has been painted, else 1 + the pass that painted the pixel
+uint8_t ImageStreamReceiver::level(uint32_t index) const {
+  uint8_t b = levels_[index >> 1];
+  return (index & 1) ? b >> 4 : b & 0x0F;
+}
+
+void ImageStreamReceiver::setLevel(uint32_t index, uint8_t level) {
+  uint8_t& b = levels_[index >> 1];
+  b = (index & 1) ? (b & 0x0F) | (level << 4) : (b & 0xF0) | level;
+}
+
+void ImageStreamReceiver::paint(uint8_t pass, uint16_t x, uint16_t y, uint8_t value) {
+  uint8_t paintLevel = pass + 1;
+  uint32_t own = (uint32_t)y * width_ + x;
+  if (level(own) != paintLevel) {
+    received_++;
+  }
+  // Fill the block, but never over something painted by the same or a finer pass
+  uint16_t xEnd = x + pgm_read_byte(&passBlockWidth[pass]);
+  uint16_t yEnd = y + pgm_read_byte(&passBlockHeight[pass]);
+  if (xEnd > width_) xEnd = width_;
+  if (yEnd > height_) yEnd = height_;
+  for (uint16_t by = y; by < yEnd; by++) {
+    uint32_t row = (uint32_t)by * width_;
+    for (uint16_t bx = x; bx < xEnd; bx++) {
+      if (level(row + bx) < paintLevel) {
+        frame_[row + bx] = value;
+        setLevel(row + bx, paintLevel);
+      }
+    }
+  }
+  frame_[own] = value;
+  setLevel(own, paintLevel);
+}
+
+bool ImageStreamReceiver::push(const MessageHelper& msg) {
+  if (msg.getCommand() != C_STREAM || msg.getStreamType() != ST_IMAGE) {
+    return false;
+  }
+  const uint8_t* payload = (const uint8_t*)msg.getPayload();
+  uint8_t pass = payload[1];
+  uint16_t width = payload[2] | (payload[3] << 8);
+  uint16_t height = payload[4] | (payload[5] << 8);
+  uint16_t chunk = payload[6] | (payload[7] << 8);
+  uint8_t count = payload[8];
+  if (pass >= IMAGE_PASSES || count > msg.getPayloadSize() - IMAGE_CHUNK_HEADER_SIZE ||
+      (uint32_t)width * height > maxPixels_) {
+    return false;
+  }
+
+  if (!started_ || payload[0] != imageId_ || width != width_ || height != height_) {
+    started_ = true;
+    imageId_ = payload[0];
+    width_ = width;
+    height_ = height;
+    received_ = 0;
+    memset(frame_, 0, (uint32_t)width * height);
+    memset(levels_, 0, IMAGE_LEVELS_SIZE(width, height));
+  }
+
+  uint16_t pw = passWidth(pass, width_);
+  uint32_t total = (uint32_t)pw * passHeight(pass, height_);
+  uint32_t first = (uint32_t)chunk * IMAGE_CHUNK_PIXELS;
+  uint8_t xStart = pgm_read_byte(&passXStart[pass]);
+  uint8_t yStart = pgm_read_byte(&passYStart[pass]);
+  uint8_t xStep = pgm_read_byte(&passXStep[pass]);
+  uint8_t yStep = pgm_read_byte(&passYStep[pass]);
+  for (uint8_t i = 0; i < count && first + i < total; i++) {
+    uint32_t index = first + i;
+    paint(pass, xStart + (index % pw) * xStep, yStart + (index / pw) * yStep, payload[IMAGE_CHUNK_HEADER_SIZE + i]);
+  }
+  return true;
+}
+
+uint8_t ImageStreamReceiver::imageId() const {
+  return imageId_;
+}
+uint16_t ImageStreamReceiver::width() const {
+  return width_;
+}
+uint16_t ImageStreamReceiver::height() const {
+  return height_;
+}
+uint32_t ImageStreamReceiver::pixelsReceived() const {
+  return received_;
+}
+bool ImageStreamReceiver::complete() const {
+  return started_ && received_ == (uint32_t)width_ * height_;
+}
@@ -0,0 +1,91 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file ImageStream.h
+ *
+ * @brief Progressive ST_IMAGE transfer over C_STREAM messages
+ *
+ * The image (8 bit grayscale) is sent in the 7 passes of the Adam7 interlacing:
+ * the first pass is a 1/8 x 1/8 preview and every following pass refines it.
+ * Each chunk carries its pass and position, so chunks can be lost or reordered.
+ * The receiver paints every pixel over the block it stands for until a finer
+ * pass replaces it, so the frame buffer can be shown at any time.
+ */
+#ifndef IMAGESTREAM_H
+#define IMAGESTREAM_H
+
+#include <Arduino.h>
+#include "Message.h"
+
+/// @brief Bytes of chunk header: image id, pass, width, height, offset in the pass, pixel count
+#define IMAGE_CHUNK_HEADER_SIZE 9
+/// @brief Pixels carried by one chunk
+#define IMAGE_CHUNK_PIXELS (MESSAGE_PAYLOAD_SIZE - IMAGE_CHUNK_HEADER_SIZE)
+/// @brief Number of passes
+#define IMAGE_PASSES 7
+/// @brief Size of the level buffer the receiver needs for a width x height image
+#define IMAGE_LEVELS_SIZE(width, height) (((uint32_t)(width) * (height) + 1) / 2)
+
+/// @brief Reads the pixel at (x, y) from the camera or the image storage
+typedef uint8_t (*ImagePixelReader)(uint16_t x, uint16_t y, void* context);
+
+
+class ImageStreamSender {
+
+ public:
+	ImageStreamSender();
+	/// @brief Starts the transfer of a new image
+	void begin(uint8_t imageId, uint16_t width, uint16_t height, ImagePixelReader reader, void* context);
+	/// @brief Fills @p msg with the next chunk
+	/// @return false when the whole image has been sent
+	bool next(MessageHelper& msg);
+
+ private:
+	ImagePixelReader reader_;
+	void* context_;
+	uint16_t width_;
+	uint16_t height_;
+	uint16_t offset_;
+	uint8_t imageId_;
+	uint8_t pass_;
+};
+
+
+class ImageStreamReceiver {
+
+ public:
+	/// @param frame buffer of maxPixels bytes, one byte per pixel, row after row
+	/// @param levels buffer of IMAGE_LEVELS_SIZE bytes (pass that painted each pixel)
+	ImageStreamReceiver(uint8_t* frame, uint8_t* levels, uint32_t maxPixels);
+	/// @brief Paints a received ST_IMAGE chunk, a new image id clears the frame
+	/// @return false if the message is not an image chunk or the image does not fit
+	bool push(const MessageHelper& msg);
+
+	uint8_t imageId() const;
+	uint16_t width() const;
+	uint16_t height() const;
+	/// @brief Number of pixels received exactly
+	uint32_t pixelsReceived() const;
+	/// @brief true once every pixel of the image has been received
+	bool complete() const;
+
+ private:
+	uint8_t level(uint32_t index) const;
+	void setLevel(uint32_t index, uint8_t level);
+	void paint(uint8_t pass, uint16_t x, uint16_t y, uint8_t value);
+
+	uint8_t* frame_;
+	uint8_t* levels_;
+	uint32_t maxPixels_;
+	uint32_t received_;
+	uint16_t width_;
+	uint16_t height_;
+	uint8_t imageId_;
+	bool started_;
+};
+
+#endif
@@ -22,13 +22,15 @@
 
 
 //Constructor
-MessageHelper::MessageHelper() { };
+MessageHelper::MessageHelper() {
+  memset(&internalMessage_, 0, sizeof(internalMessage_));
+}
 
 void MessageHelper::setSensorID(uint8_t id) {
   internalMessage_.sensor_id = id;
 }
 void MessageHelper::setSensorAddress(uint16_t address) {
-  internalMessage_.sensor_address = address;
+  messageSetAddress(internalMessage_, address);
 }
 void MessageHelper::setSensorType(Sensor_type type) {
   internalMessage_.sensorType = type;
@@ -42,15 +44,20 @@ void MessageHelper::setCommand(Sensor_command command) {
 void MessageHelper::setSystemMessageType(System_message_type type) {
   internalMessage_.messageType = type;
 }
+// The extension flag shares the datatype byte and is kept
 void MessageHelper::setPayloadType(Payload_type type) {
-  internalMessage_.datatype = type;
+  internalMessage_.datatype = (Payload_type)((type & ~MESSAGE_EXTENDED) | (internalMessage_.datatype & MESSAGE_EXTENDED));
+}
+// C_STREAM messages carry no system message, the same byte holds the stream type
+void MessageHelper::setStreamType(mstream_type type) {
+  internalMessage_.messageType = (System_message_type)type;
 }
 
 unsigned char MessageHelper::getSensorID() const {
   return internalMessage_.sensor_id;
 }
 uint16_t MessageHelper::getSensorAddress() const {
-  return internalMessage_.sensor_address;
+  return messageGetAddress(internalMessage_);
 }
 Sensor_type MessageHelper::getSensorType() const {
   return internalMessage_.sensorType;
@@ -65,11 +72,138 @@ System_message_type MessageHelper::getSystemMessageType() const {
   return internalMessage_.messageType;
 }
 Payload_type MessageHelper::getPayloadType() const {
-  return internalMessage_.datatype;
+  return (Payload_type)(internalMessage_.datatype & ~MESSAGE_EXTENDED);
+}
+mstream_type MessageHelper::getStreamType() const {
+  return (mstream_type)internalMessage_.messageType;
 }
 
 char* MessageHelper::getPayload() {
-  return internalMessage_.payload;
+  return internalMessage_.payload + extensionSize();
+}
+const char* MessageHelper::getPayload() const {
+  return internalMessage_.payload + extensionSize();
+}
+uint8_t MessageHelper::getPayloadSize() const {
+  return MESSAGE_PAYLOAD_SIZE - extensionSize();
+}
+
+// Size of the extension area, length byte included. A length too big (corrupted
+// frame) is clamped so getPayload() stays in the message, checkExtensions() rejects it.
+uint8_t MessageHelper::extensionSize() const {
+  if (!(internalMessage_.datatype & MESSAGE_EXTENDED)) {
+    return 0;
+  }
+  uint8_t length = internalMessage_.payload[0];
+  return 1 + (length < MESSAGE_EXTENSIONS_SIZE ? length : MESSAGE_EXTENSIONS_SIZE);
+}
+
+bool MessageHelper::hasExtensions() const {
+  return extensionSize() != 0;
+}
+
+// Moves the payload bytes from at to the end by delta, the bytes pushed out are lost
+void MessageHelper::shiftPayload(uint8_t at, int8_t delta) {
+  char* p = internalMessage_.payload;
+  if (delta > 0) {
+    memmove(p + at + delta, p + at, MESSAGE_PAYLOAD_SIZE - at - delta);
+  } else {
+    memmove(p + at, p + at - delta, MESSAGE_PAYLOAD_SIZE - at + delta);
+    memset(p + MESSAGE_PAYLOAD_SIZE + delta, 0, -delta);
+  }
+}
+
+const uint8_t* MessageHelper::findExtension(uint8_t type, uint8_t* length) const {
+  const uint8_t* p = (const uint8_t*)internalMessage_.payload + 1;
+  const uint8_t* end = (const uint8_t*)internalMessage_.payload + extensionSize();
+  while (p + 2 <= end && p + 2 + p[1] <= end) {
+    if (p[0] == type) {
+      *length = p[1];
+      return p + 2;
+    }
+    p += 2 + p[1];
+  }
+  return NULL;
+}
+
+bool MessageHelper::setExtension(uint8_t type, const void* value, uint8_t length) {
+  uint8_t oldLength;
+  const uint8_t* old = findExtension(type, &oldLength);
+  uint8_t area = extensionSize();
+  uint8_t used = area ? area - 1 : 0;
+  if (old) {
+    used -= 2 + oldLength;
+  }
+  if (length > MESSAGE_EXTENSIONS_SIZE - 2 || used + 2 + length > MESSAGE_EXTENSIONS_SIZE) {
+    return false;
+  }
+  if (old) {
+    removeExtension(type);
+    area = extensionSize();
+  }
+  uint8_t at = area ? area : 1;
+  shiftPayload(area, 2 + length + (area ? 0 : 1));
+  char* p = internalMessage_.payload;
+  p[at] = type;
+  p[at + 1] = length;
+  // A flag has no value, @p value may then be NULL
+  if (length) {
+    memcpy(p + at + 2, value, length);
+  }
+  p[0] = used + 2 + length;
+  internalMessage_.datatype = (Payload_type)(internalMessage_.datatype | MESSAGE_EXTENDED);
+  return true;
+}
+
+bool MessageHelper::removeExtension(uint8_t type) {
+  uint8_t length;
+  const uint8_t* value = findExtension(type, &length);
+  if (value == NULL) {
+    return false;
+  }
+  uint8_t at = value - 2 - (const uint8_t*)internalMessage_.payload;
+  uint8_t used = internalMessage_.payload[0] - (2 + length);
+  if (used == 0) {
+    clearExtensions();
+  } else {
+    shiftPayload(at, -(2 + length));
+    internalMessage_.payload[0] = used;
+  }
+  return true;
+}
+
+void MessageHelper::clearExtensions() {
+  uint8_t area = extensionSize();
+  if (area) {
+    shiftPayload(0, -area);
+    internalMessage_.datatype = getPayloadType();
+  }
+}
+
+bool MessageHelper::checkExtensions(const uint8_t* understood, uint8_t count) const {
+  uint8_t area = extensionSize();
+  if (area == 0) {
+    return true;
+  }
+  const uint8_t* p = (const uint8_t*)internalMessage_.payload + 1;
+  const uint8_t* end = (const uint8_t*)internalMessage_.payload + area;
+  if ((uint8_t)internalMessage_.payload[0] > MESSAGE_EXTENSIONS_SIZE) {
+    return false;
+  }
+  while (p < end) {
+    if (p + 2 > end || p + 2 + p[1] > end) {
+      return false;
+    }
+    if (p[0] & X_CRITICAL) {
+      uint8_t i = 0;
+      while (i < count && understood[i] != p[0]) i++;
+      if (i == count) {
+        return false;
+      }
+    }
+    p += 2 + p[1];
+  }
+  return true;
 }
 
 char* MessageHelper::toString() {
@@ -94,6 +228,121 @@ char* MessageHelper::toString() {
 
 }
 
+// handles single character hex (0 - 15)
+static char i2h(uint8_t i) {
+  uint8_t k = i & 0x0F;
+  if (k <= 9)
+    return '0' + k;
+  else
+    return 'A' + k - 10;
+}
+
+/*
+ * Writes the message as a serial protocol line for the controllers:
+ * address;sensor id;command;0;type;payload\n
+ * Numeric payloads are stored little endian. Returns the length of the line,
+ * 0 if it does not fit in size (NUL included), never a partial line: a buffer
+ * of MESSAGE_LINE_SIZE takes any message.
+ */
+uint16_t MessageHelper::serialize(char* buffer, uint16_t size) const {
+  const Message& m = internalMessage_;
+  const char* payload = getPayload();
+  const uint8_t* p = (const uint8_t*)payload;
+  uint8_t payloadSize = getPayloadSize();
+  Payload_type datatype = getPayloadType();
+  uint8_t type;
+  switch (m.sensorCommand) {
+    case C_PRESENTATION_CHILDREN:
+    case C_PRESENTATION_PARENT:
+      type = m.sensorType;
+      break;
+    case C_SYSTEM:
+    case C_STREAM:
+      type = m.messageType;
+      break;
+    default:
+      type = m.informationType;
+  }
+  int n = snprintf_P(buffer, size, PSTR("%u;%u;%u;0;%u;"),
+                     (unsigned)messageGetAddress(m), (unsigned)m.sensor_id,
+                     (unsigned)m.sensorCommand, (unsigned)type);
+  if (n < 0 || n >= size) {
+    return 0;
+  }
+  uint16_t len = n;
+
+  if (m.sensorCommand == C_STREAM) {
+    if (len + 2 * payloadSize + 2 > size) {
+      return 0;
+    }
+    for (uint8_t i = 0; i < payloadSize; i++) {
+      buffer[len++] = i2h(p[i] >> 4);
+      buffer[len++] = i2h(p[i]);
+    }
+  } else if (datatype == P_STRING) {
+    for (uint8_t i = 0; i < payloadSize && payload[i]; i++) {
+      if (len + 2 >= size) {
+        return 0;
+      }
+      buffer[len++] = payload[i];
+    }
+  } else {
+    char* out = buffer + len;
+    uint16_t room = size - len;
+    n = 0;
+    switch (datatype) {
+      case P_INT:
+        n = snprintf_P(out, room, PSTR("%d"), (int)(int16_t)(p[0] | (p[1] << 8)));
+        break;
+      case P_UINT:
+        n = snprintf_P(out, room, PSTR("%u"), (unsigned)(p[0] | (p[1] << 8)));
+        break;
+      case P_LONG32:
+      case P_ULONG32: {
+        uint32_t v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        if (datatype == P_LONG32) {
+          n = snprintf_P(out, room, PSTR("%ld"), (long)(int32_t)v);
+        } else {
+          n = snprintf_P(out, room, PSTR("%lu"), (unsigned long)v);
+        }
+        break;
+      }
+      case P_FLOAT32: {
+        float v;
+        memcpy(&v, p, sizeof(v));
+#ifdef __AVR__
+        char number[16];
+        dtostrf(v, 1, 2, number);
+        n = snprintf_P(out, room, PSTR("%s"), number);
+#else
+        n = snprintf(out, room, "%.2f", (double)v);
+#endif
+        break;
+      }
+      case P_CHAR:
+        n = snprintf_P(out, room, PSTR("%d"), (int)(int8_t)p[0]);
+        break;
+      case P_BOOL:
+      case P_UCHAR:
+      case P_BYNARY_BYTE:
+        n = snprintf_P(out, room, PSTR("%u"), (unsigned)p[0]);
+        break;
+      default:
+        break;
+    }
+    if (n < 0 || n >= room) {
+      return 0;
+    }
+    len += n;
+  }
+
+  if (len + 2 > size) {
+    return 0;
+  }
+  buffer[len++] = '\n';
+  buffer[len] = '\0';
+  return len;
+}
 
 
 //
@@ -23,6 +23,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 
 /// @brief The command field (message-type) defines the overall properties of a message
 typedef enum : unsigned char {
@@ -181,7 +182,10 @@ typedef enum : unsigned char {
 	I_DEBUG					= 28,	//!< Debug message
 	I_SPECIAL_FUNCTIONSLIST= 29,
 	I_ACK	= 30, //!< system message type that goes in pair with C_ACK
-	I_NEWVALUE = 31 //!< the sensor is sending a new value
+	I_NEWVALUE = 31, //!< the sensor is sending a new value
+	I_AGGREGATE				= 32,	//!< Readings of several children held by a repeater (see RepeaterAggregator.h)
+	I_SYNC					= 33,	//!< Registry state sync between the gateway and a controller (see RegistrySync.h)
+	I_MERKLE				= 34	//!< Hashes of the registry tree, to find the nodes two registries disagree on (see RegistryMerkle.h)
 } System_message_type;
 
 
@@ -209,11 +213,45 @@ typedef enum : unsigned char{
 	P_BOOL					= 10, //!< Payload type is bool
 	P_CHAR					= 11, //!< Payload type is char
 	P_UCHAR					= 12, //!< Payload type is char
-	P_BYNARY_BYTE		= 13 //!< Payload type is char
+	P_BYNARY_BYTE		= 13, //!< Payload type is char
+	P_SUMMARY				= 14	//!< Payload is min, max, avg (float32) and count (uint8) of a group of readings
 
 } Payload_type;
 
 
+/// @brief Size of the payload area of a Message
+#define MESSAGE_PAYLOAD_SIZE 122
+/// @brief Longest line written by MessageHelper::serialize(), a C_STREAM payload in hex, NUL included
+#define MESSAGE_LINE_SIZE (sizeof("65535;255;255;0;255;") - 1 + 2 * MESSAGE_PAYLOAD_SIZE + 2)
+
+/**
+ * Header extensions
+ *
+ * A message that carries extensions has MESSAGE_EXTENDED set in its datatype
+ * byte. The payload then starts with the extension area: one byte with the
+ * length of the extensions, then the extensions, each one a type byte, a length
+ * byte and the value (little endian). getPayload() points after the area, so a
+ * message without extensions costs no byte and a decoder that does not know an
+ * extension just skips it, unless its type has X_CRITICAL set: such a message
+ * must be dropped by a decoder that does not understand it (see checkExtensions()).
+ */
+#define MESSAGE_EXTENDED 0x80
+/// @brief Maximum length of the extensions (length byte excluded)
+#ifndef MESSAGE_EXTENSIONS_SIZE
+#define MESSAGE_EXTENSIONS_SIZE 32
+#endif
+
+/// @brief Type of header extension
+typedef enum : unsigned char {
+	X_SEQUENCE				= 1,	//!< uint16 sequence number of the message
+	X_TIMESTAMP				= 2,	//!< uint32 time of the measure (millis of the sender)
+	X_ACK					= 3,	//!< uint16 sequence number of the last message received from the destination
+	X_NO_CACHE				= 4,	//!< No value, a C_REQ that must reach the node (see NodeRegistry::answerRequest())
+	X_LOAD					= 5,	//!< uint8 Load_level of the channel advertised by the gateway (see Congestion.h)
+	X_CRITICAL				= 0x80,	//!< Flag, the message must be dropped if the extension is not understood
+	X_SECURITY_TAG			= 0x84	//!< Authentication tag of the message
+} Message_extension_type;
+
 // The sensor id is only for the actuator that has connected the sensor
 // in this implementation the sensor always communicates with a actuator that is the relay to some other object
 // one actuator can handle at maximum 5 sensor at a time (limit of RF24Network structure
@@ -224,16 +262,43 @@ typedef enum : unsigned char{
 // to the receiver
 //in order to achieve this, each node must keep a sort of arp table with the id of node that he can reach.
 
+// Wire layout: every field is a byte or an array of bytes, so there is no padding
+// and a received frame can be used in place (see messageView()) on any host.
 typedef struct {
 	uint8_t sensor_id; // 1 byte
-	uint16_t sensor_address; // 16 byte
+	uint8_t sensor_address[2]; // 2 byte, little endian, use messageGetAddress()
 	Sensor_command sensorCommand; // 1 byte
 	Sensor_type sensorType; // 1 byte
 	Sensor_information_type informationType; // 1 byte
 	System_message_type messageType; // 1 byte
 	Payload_type datatype; // 1 byte
-	char payload[122];
-} Message; // size = 144;
+	char payload[MESSAGE_PAYLOAD_SIZE];
+} Message; // size = 130;
+
+static_assert(sizeof(Sensor_command) == 1 && sizeof(Sensor_type) == 1 &&
+              sizeof(Sensor_information_type) == 1 && sizeof(System_message_type) == 1 &&
+              sizeof(Payload_type) == 1, "Message enums must be one byte");
+static_assert(offsetof(Message, sensor_address) == 1, "Message layout");
+static_assert(offsetof(Message, sensorCommand) == 3, "Message layout");
+static_assert(offsetof(Message, datatype) == 7, "Message layout");
+static_assert(offsetof(Message, payload) == 8, "Message layout");
+static_assert(sizeof(Message) == 8 + MESSAGE_PAYLOAD_SIZE, "Message must not be padded");
+
+/// @brief Reads the little endian sensor address
+inline uint16_t messageGetAddress(const Message& message) {
+	return message.sensor_address[0] | (message.sensor_address[1] << 8);
+}
+
+/// @brief Writes the sensor address little endian
+inline void messageSetAddress(Message& message, uint16_t address) {
+	message.sensor_address[0] = (uint8_t)address;
+	message.sensor_address[1] = (uint8_t)(address >> 8);
+}
+
+/// @brief Views a received frame of sizeof(Message) bytes as a Message, without copy
+inline const Message* messageView(const void* frame) {
+	return (const Message*)frame;
+}
 
 
 
@@ -243,6 +308,7 @@ class MessageHelper {
 	Message internalMessage_;
 	MessageHelper();
 	char* toString();
+	uint16_t serialize(char* buffer, uint16_t size) const;
 	void setSensorID(uint8_t id);
 	void setSensorAddress(uint16_t address);
 	void setSensorType(Sensor_type type);
@@ -250,6 +316,7 @@ class MessageHelper {
 	void setCommand(Sensor_command command);
 	void setSystemMessageType(System_message_type type);
 	void setPayloadType(Payload_type type);
+	void setStreamType(mstream_type type);
 	unsigned char getSensorID() const;
 	uint16_t getSensorAddress() const;
 	Sensor_type getSensorType() const;
@@ -257,7 +324,31 @@ class MessageHelper {
 	Sensor_command getCommand() const;
 	System_message_type getSystemMessageType() const;
 	Payload_type getPayloadType() const;
+	mstream_type getStreamType() const;
+	/// @brief The payload, after the extension area if any
 	char* getPayload();
+	const char* getPayload() const;
+	/// @brief Room left for the payload, MESSAGE_PAYLOAD_SIZE without extensions
+	uint8_t getPayloadSize() const;
+
+	/// @brief Adds or replaces an extension. The payload is moved after the
+	/// extension area and loses its last bytes.
+	/// @return false if the extensions would not fit in MESSAGE_EXTENSIONS_SIZE
+	bool setExtension(uint8_t type, const void* value, uint8_t length);
+	/// @brief Value of an extension, NULL if the message does not carry it
+	const uint8_t* findExtension(uint8_t type, uint8_t* length) const;
+	/// @brief Removes an extension, the payload is moved back
+	bool removeExtension(uint8_t type);
+	/// @brief Removes all the extensions, to be called before reusing a message
+	void clearExtensions();
+	bool hasExtensions() const;
+	/// @brief Returns false if the extension area is malformed or carries an
+	/// X_CRITICAL extension missing from @p understood
+	bool checkExtensions(const uint8_t* understood, uint8_t count) const;
+
+ private:
+	uint8_t extensionSize() const;
+	void shiftPayload(uint8_t at, int8_t delta);
 };
 
 #endif
@@ -0,0 +1,31 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+
+#include "MessageDispatcher.h"
+
+// Offset in Message of the type byte of each command, read without a switch
+static const uint8_t typeOffset[DISPATCH_COMMANDS] PROGMEM = {
+  offsetof(Message, sensorType),       // C_PRESENTATION_CHILDREN
+  offsetof(Message, sensorType),       // C_PRESENTATION_PARENT
+  offsetof(Message, informationType),  // C_SET
+  offsetof(Message, informationType),  // C_REQ
+  offsetof(Message, messageType),      // C_SYSTEM
+  offsetof(Message, messageType),      // C_STREAM
+  offsetof(Message, informationType)   // C_ACK
+};
+
+uint16_t dispatchKey(const MessageHelper& msg) {
+  uint8_t command = msg.internalMessage_.sensorCommand;
+  if (command >= DISPATCH_COMMANDS) {
+    return DISPATCH_COMMANDS * DISPATCH_TYPES;
+  }
+  uint8_t type = ((const uint8_t*)&msg.internalMessage_)[pgm_read_byte(&typeOffset[command])];
+  if (type >= DISPATCH_TYPES) {
+    return DISPATCH_COMMANDS * DISPATCH_TYPES;
+  }
+  return command * DISPATCH_TYPES + type;
+}
@@ -0,0 +1,146 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file MessageDispatcher.h
+ *
+ * @brief Message handlers dispatched through a table built at compile time
+ *
+ * Instead of nested switches on the command and on the type, the handlers are
+ * listed in the sketch:
+ *
+ *     void onTemp(const MessageHelper& msg) { ... }
+ *     void onConfig(const MessageHelper& msg) { ... }
+ *
+ *     typedef MessageDispatcher<
+ *       Handler<C_SET, V_TEMP, onTemp>,
+ *       Handler<C_SYSTEM, I_CONFIG, onConfig>,
+ *       Handler<C_REQ, DISPATCH_ANY_TYPE, onRequest>
+ *     > Dispatcher;
+ *     ...
+ *     Dispatcher::dispatch(msg);
+ *
+ * The type is the Sensor_type of the presentations, the System_message_type
+ * of C_SYSTEM, the mstream_type of C_STREAM and the Sensor_information_type
+ * of the other commands. The compiler fills a PROGMEM table with one byte per
+ * command and type (DISPATCH_COMMANDS * DISPATCH_TYPES bytes) giving the
+ * handler, the first matching one of the list. dispatch() reads that byte and
+ * the handler pointer: its cost does not depend on the number of handlers.
+ */
+#ifndef MESSAGEDISPATCHER_H
+#define MESSAGEDISPATCHER_H
+
+#include <Arduino.h>
+#include "Message.h"
+
+#define DISPATCH_COMMANDS 7
+#define DISPATCH_TYPES 64
+/// @brief Type of a handler called for all the types of its command
+#define DISPATCH_ANY_TYPE 0xFF
+
+typedef void (*MessageHandlerFunction)(const MessageHelper& msg);
+
+/// @brief Index of a message in the dispatch table, DISPATCH_COMMANDS * DISPATCH_TYPES if out of it
+uint16_t dispatchKey(const MessageHelper& msg);
+
+/// @brief A handler of the messages of command @p Command and type @p Type
+template <Sensor_command Command, uint8_t Type, MessageHandlerFunction Function>
+struct Handler {
+	static_assert(Command < DISPATCH_COMMANDS, "Unknown command");
+	static_assert(Type < DISPATCH_TYPES || Type == DISPATCH_ANY_TYPE, "Type out of the dispatch table");
+	static constexpr bool matches(uint16_t key) {
+		return key / DISPATCH_TYPES == Command && (Type == DISPATCH_ANY_TYPE || key % DISPATCH_TYPES == Type);
+	}
+	static constexpr MessageHandlerFunction function() {
+		return Function;
+	}
+};
+
+/// @brief Slot (1 based) of the first handler matching a key, 0 if none
+template <typename... Handlers>
+struct DispatchSlot {
+	static constexpr uint8_t of(uint16_t, uint8_t) {
+		return 0;
+	}
+};
+
+template <typename First, typename... Rest>
+struct DispatchSlot<First, Rest...> {
+	static constexpr uint8_t of(uint16_t key, uint8_t slot) {
+		return First::matches(key) ? slot : DispatchSlot<Rest...>::of(key, slot + 1);
+	}
+};
+
+/// @brief 0, 1, ... N - 1 as a parameter pack, built in log(N) steps
+template <uint16_t... I>
+struct DispatchIndices {
+};
+
+template <typename First, typename Second>
+struct DispatchJoin;
+
+template <uint16_t... First, uint16_t... Second>
+struct DispatchJoin<DispatchIndices<First...>, DispatchIndices<Second...> > {
+	typedef DispatchIndices<First..., (uint16_t)(sizeof...(First) + Second)...> type;
+};
+
+template <uint16_t N>
+struct DispatchRange {
+	typedef typename DispatchJoin<typename DispatchRange<N / 2>::type,
+	                              typename DispatchRange<N - N / 2>::type>::type type;
+};
+
+template <>
+struct DispatchRange<0> {
+	typedef DispatchIndices<> type;
+};
+
+template <>
+struct DispatchRange<1> {
+	typedef DispatchIndices<0> type;
+};
+
+template <typename Indices, typename... Handlers>
+struct DispatchTable;
+
+template <uint16_t... Keys, typename... Handlers>
+struct DispatchTable<DispatchIndices<Keys...>, Handlers...> {
+	static const uint8_t slots[sizeof...(Keys)];
+};
+
+template <uint16_t... Keys, typename... Handlers>
+const uint8_t DispatchTable<DispatchIndices<Keys...>, Handlers...>::slots[sizeof...(Keys)] PROGMEM = {
+	DispatchSlot<Handlers...>::of(Keys, 1)...
+};
+
+/// @brief The dispatcher of a list of handlers, see the file description
+template <typename... Handlers>
+struct MessageDispatcher {
+	static_assert(sizeof...(Handlers) > 0 && sizeof...(Handlers) < 255, "1 to 254 handlers");
+
+	typedef DispatchTable<typename DispatchRange<DISPATCH_COMMANDS * DISPATCH_TYPES>::type, Handlers...> table;
+	static const MessageHandlerFunction functions[sizeof...(Handlers)];
+
+	/// @return false if no handler takes the message
+	static bool dispatch(const MessageHelper& msg) {
+		uint16_t key = dispatchKey(msg);
+		uint8_t slot = key < DISPATCH_COMMANDS * DISPATCH_TYPES ? pgm_read_byte(&table::slots[key]) : 0;
+		if (slot == 0) {
+			return false;
+		}
+		MessageHandlerFunction function;
+		memcpy_P(&function, &functions[slot - 1], sizeof(function));
+		function(msg);
+		return true;
+	}
+};
+
+template <typename... Handlers>
+const MessageHandlerFunction MessageDispatcher<Handlers...>::functions[sizeof...(Handlers)] PROGMEM = {
+	Handlers::function()...
+};
+
+#endif
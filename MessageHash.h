@@ -0,0 +1,38 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file MessageHash.h
+ *
+ * @brief 32 bit FNV-1a hash used to identify content sent over the network
+ */
+#ifndef MESSAGEHASH_H
+#define MESSAGEHASH_H
+
+#include <stdint.h>
+
+#define MESSAGE_HASH_SEED 2166136261UL
+#define MESSAGE_HASH_PRIME 16777619UL
+
+/// @brief Adds @p length bytes to the hash @p hash (start with MESSAGE_HASH_SEED)
+inline uint32_t messageHash(const void* data, uint16_t length, uint32_t hash = MESSAGE_HASH_SEED) {
+	const uint8_t* p = (const uint8_t*)data;
+	for (uint16_t i = 0; i < length; i++) {
+		hash = (hash ^ p[i]) * MESSAGE_HASH_PRIME;
+	}
+	return hash;
+}
+
+/// @brief Compile time version of messageHash() over a list of bytes
+constexpr uint32_t messageHashBytes(uint32_t hash) {
+	return hash;
+}
+template <typename... Rest>
+constexpr uint32_t messageHashBytes(uint32_t hash, uint8_t byte, Rest... rest) {
+	return messageHashBytes((uint32_t)((hash ^ byte) * MESSAGE_HASH_PRIME), rest...);
+}
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+
+#include "MessageTransport.h"
+
+//Constructor
+RF24NetworkTransport::RF24NetworkTransport(RF24Network& network, unsigned char headerType,
+                                           HeaderCompressor* compressor)
+  : network_(network), headerType_(headerType), compressor_(compressor), eventHandler_(NULL) { }
+
+void RF24NetworkTransport::setEventHandler(EventHandler handler) {
+  eventHandler_ = handler;
+}
+
+// A peer whose context was dropped sends a full header next, rather than frames that cannot be read
+void RF24NetworkTransport::resyncEvicted() {
+  uint16_t peer;
+  if (compressor_->takeEvicted(&peer)) {
+    uint8_t frame[2];
+    RF24NetworkHeader header(peer, headerType_);
+    network_.write(header, frame, compressor_->resyncRequest(peer, frame));
+  }
+}
+
+bool RF24NetworkTransport::receive(MessageHelper& msg, uint16_t* from) {
+  network_.update();
+  RF24NetworkHeader header;
+  // Event frames are handled as soon as they are read, they are not messages
+  while (network_.available() && network_.peek(header) && header.type == EVENT_HEADER_TYPE) {
+    uint8_t event;
+    network_.read(header, &event, 1);
+    if (eventHandler_ == NULL) {
+      eventToMessage(event, header.from_node, msg);
+      *from = header.from_node;
+      return true;
+    }
+    eventHandler_(header.from_node, eventChild(event), eventKind(event), eventValue(event));
+  }
+  if (!network_.available()) {
+    return false;
+  }
+  if (compressor_ == NULL) {
+    network_.read(header, &msg.internalMessage_, sizeof(Message));
+    *from = header.from_node;
+    return true;
+  }
+  uint8_t frame[HC_FRAME_SIZE];
+  uint16_t length = network_.read(header, frame, sizeof(frame));
+  *from = header.from_node;
+  Header_result result = compressor_->decompress(frame, length, header.from_node, msg);
+  if (result == HC_RESYNC) {
+    RF24NetworkHeader reply(header.from_node, headerType_);
+    network_.write(reply, frame, compressor_->resyncRequest(header.from_node, frame));
+  }
+  resyncEvicted();
+  return result == HC_OK;
+}
+
+bool RF24NetworkTransport::send(const MessageHelper& msg, uint16_t to) {
+  RF24NetworkHeader header(to, headerType_);
+  if (compressor_ == NULL) {
+    return network_.write(header, &msg.internalMessage_, sizeof(Message));
+  }
+  uint8_t frame[HC_FRAME_SIZE];
+  bool sent = network_.write(header, frame, compressor_->compress(msg, to, frame, sizeof(frame)));
+  resyncEvicted();
+  return sent;
+}
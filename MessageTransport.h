@@ -0,0 +1,61 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file MessageTransport.h
+ *
+ * @brief Interface of a link that carries Messages, and its RF24Network implementation
+ *
+ * Gateway code talks to a MessageTransport, so a radio can be replaced by a
+ * simulated link or by a bridge on a serial port. RF24NetworkTransport can
+ * compress the headers of the messages (see HeaderCompressor.h), both ends of
+ * the link must then use a compressor. Event frames (see EventFrame.h) go to
+ * the event handler, or are delivered as C_SET messages when there is none.
+ */
+#ifndef MESSAGETRANSPORT_H
+#define MESSAGETRANSPORT_H
+
+#include <Arduino.h>
+#include "RF24Network.h"
+#include "Message.h"
+#include "HeaderCompressor.h"
+#include "EventFrame.h"
+
+class MessageTransport {
+
+ public:
+	virtual ~MessageTransport() {}
+	/// @brief Polls the link and reads one message
+	/// @param from network address the message has been received from
+	/// @return false if there is no message
+	virtual bool receive(MessageHelper& msg, uint16_t* from) = 0;
+	/// @brief Sends a message to the network address @p to
+	virtual bool send(const MessageHelper& msg, uint16_t to) = 0;
+};
+
+
+class RF24NetworkTransport : public MessageTransport {
+
+ public:
+	/// @param headerType RF24NetworkHeader type used for the messages
+	/// @param compressor header compression of the links, NULL to send whole Messages
+	RF24NetworkTransport(RF24Network& network, unsigned char headerType = 0,
+	                     HeaderCompressor* compressor = NULL);
+	virtual bool receive(MessageHelper& msg, uint16_t* from);
+	virtual bool send(const MessageHelper& msg, uint16_t to);
+	/// @brief Handles the event frames in receive(), before any other message
+	void setEventHandler(EventHandler handler);
+
+ private:
+	void resyncEvicted();
+
+	RF24Network& network_;
+	unsigned char headerType_;
+	HeaderCompressor* compressor_;
+	EventHandler eventHandler_;
+};
+
+#endif
@@ -0,0 +1,134 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+
+#include "MultiRadio.h"
+#include "MessageHash.h"
+
+//Constructor
+MultiRadioFrontEnd::MultiRadioFrontEnd() {
+  count_ = 0;
+  next_ = 0;
+  last_ = 0;
+  seenHead_ = 0;
+  linkVictim_ = 0;
+  duplicates_ = 0;
+  memset(seen_, 0, sizeof(seen_));
+  for (uint8_t i = 0; i < MULTIRADIO_MAX_NODES; i++) {
+    links_[i].used = false;
+  }
+}
+
+int8_t MultiRadioFrontEnd::addTransport(MessageTransport* transport) {
+  if (count_ == MULTIRADIO_MAX_TRANSPORTS || transport == NULL) {
+    return -1;
+  }
+  transports_[count_] = transport;
+  return count_++;
+}
+
+bool MultiRadioFrontEnd::isDuplicate(uint32_t fingerprint, uint32_t now) {
+  for (uint8_t i = 0; i < MULTIRADIO_DEDUP_SIZE; i++) {
+    if (seen_[i].fingerprint == fingerprint && seen_[i].time != 0 &&
+        now - seen_[i].time < MULTIRADIO_DEDUP_WINDOW) {
+      return true;
+    }
+  }
+  seen_[seenHead_].fingerprint = fingerprint;
+  seen_[seenHead_].time = now ? now : 1;
+  seenHead_ = (seenHead_ + 1) % MULTIRADIO_DEDUP_SIZE;
+  return false;
+}
+
+// The counters of a node are halved when one saturates, so old receptions fade out
+void MultiRadioFrontEnd::countReception(uint16_t address, uint8_t transport) {
+  Link* link = NULL;
+  for (uint8_t i = 0; i < MULTIRADIO_MAX_NODES && link == NULL; i++) {
+    if (links_[i].used && links_[i].address == address) {
+      link = &links_[i];
+    }
+  }
+  for (uint8_t i = 0; i < MULTIRADIO_MAX_NODES && link == NULL; i++) {
+    if (!links_[i].used) {
+      link = &links_[i];
+    }
+  }
+  if (link == NULL) {
+    link = &links_[linkVictim_];
+    linkVictim_ = (linkVictim_ + 1) % MULTIRADIO_MAX_NODES;
+  }
+  if (!link->used || link->address != address) {
+    link->used = true;
+    link->address = address;
+    memset(link->hits, 0, sizeof(link->hits));
+  }
+  if (link->hits[transport] == 255) {
+    for (uint8_t i = 0; i < MULTIRADIO_MAX_TRANSPORTS; i++) {
+      link->hits[i] >>= 1;
+    }
+  }
+  link->hits[transport]++;
+}
+
+bool MultiRadioFrontEnd::receive(MessageHelper& msg, uint16_t* from) {
+  // Stops after a whole round of transports without any message
+  for (uint8_t idle = 0; idle < count_; ) {
+    uint8_t index = next_;
+    next_ = (next_ + 1) % count_;
+    if (!transports_[index]->receive(msg, from)) {
+      idle++;
+      continue;
+    }
+    idle = 0;
+    // The quality is the one of the link to the last hop, not to the sender
+    countReception(*from, index);
+    if (isDuplicate(messageHash(&msg.internalMessage_, sizeof(Message)), millis())) {
+      duplicates_++;
+      continue;
+    }
+    last_ = index;
+    return true;
+  }
+  return false;
+}
+
+bool MultiRadioFrontEnd::send(const MessageHelper& msg, uint16_t to) {
+  int8_t best = bestTransport(to);
+  if (best >= 0 && transports_[best]->send(msg, to)) {
+    return true;
+  }
+  for (uint8_t i = 0; i < count_; i++) {
+    if (i != best && transports_[i]->send(msg, to)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint8_t MultiRadioFrontEnd::lastTransport() const {
+  return last_;
+}
+
+int8_t MultiRadioFrontEnd::bestTransport(uint16_t address) const {
+  for (uint8_t i = 0; i < MULTIRADIO_MAX_NODES; i++) {
+    if (links_[i].used && links_[i].address == address) {
+      int8_t best = -1;
+      uint8_t bestHits = 0;
+      for (uint8_t t = 0; t < count_; t++) {
+        if (links_[i].hits[t] > bestHits) {
+          bestHits = links_[i].hits[t];
+          best = t;
+        }
+      }
+      return best;
+    }
+  }
+  return -1;
+}
+
+uint32_t MultiRadioFrontEnd::duplicates() const {
+  return duplicates_;
+}
@@ -0,0 +1,88 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file MultiRadio.h
+ *
+ * @brief Gateway front end merging several radio bridges into one stream
+ *
+ * The transports are polled in turn, one message at a time, so the merged
+ * stream keeps the order of each bridge and no bridge can starve the others.
+ * A message heard by several bridges is delivered once: the fingerprints of
+ * the recent messages are kept for MULTIRADIO_DEDUP_WINDOW ms. Every reception,
+ * duplicates included, counts for the link quality between the network address
+ * it came from (the node, or the repeater it went through) and a bridge, and
+ * downlink messages go through the bridge that hears their next hop best.
+ */
+#ifndef MULTIRADIO_H
+#define MULTIRADIO_H
+
+#include <Arduino.h>
+#include "Message.h"
+#include "MessageTransport.h"
+
+#ifndef MULTIRADIO_MAX_TRANSPORTS
+#define MULTIRADIO_MAX_TRANSPORTS 4
+#endif
+/// @brief Number of recent fingerprints kept for the deduplication
+#ifndef MULTIRADIO_DEDUP_SIZE
+#define MULTIRADIO_DEDUP_SIZE 16
+#endif
+/// @brief Time in ms during which a copy of a message is dropped
+#ifndef MULTIRADIO_DEDUP_WINDOW
+#define MULTIRADIO_DEDUP_WINDOW 50
+#endif
+/// @brief Number of nodes the link quality is tracked for
+#ifndef MULTIRADIO_MAX_NODES
+#define MULTIRADIO_MAX_NODES 16
+#endif
+
+
+class MultiRadioFrontEnd : public MessageTransport {
+
+ public:
+	MultiRadioFrontEnd();
+	/// @return the index of the transport, -1 if there is no room left
+	int8_t addTransport(MessageTransport* transport);
+	/// @brief Reads the next message of the merged stream, duplicates are dropped
+	virtual bool receive(MessageHelper& msg, uint16_t* from);
+	/// @brief Sends through the best bridge for the network address @p to,
+	/// and through the other bridges if that one fails
+	virtual bool send(const MessageHelper& msg, uint16_t to);
+	/// @brief Transport the last message returned by receive() came from
+	uint8_t lastTransport() const;
+	/// @brief Best transport for a network address, -1 if it has not been heard yet
+	int8_t bestTransport(uint16_t address) const;
+	/// @brief Number of duplicates dropped
+	uint32_t duplicates() const;
+
+ private:
+	typedef struct {
+		uint32_t fingerprint;
+		uint32_t time;
+	} Seen;
+
+	typedef struct {
+		uint16_t address;
+		bool used;
+		uint8_t hits[MULTIRADIO_MAX_TRANSPORTS];
+	} Link;
+
+	bool isDuplicate(uint32_t fingerprint, uint32_t now);
+	void countReception(uint16_t address, uint8_t transport);
+
+	MessageTransport* transports_[MULTIRADIO_MAX_TRANSPORTS];
+	uint8_t count_;
+	uint8_t next_;
+	uint8_t last_;
+	Seen seen_[MULTIRADIO_DEDUP_SIZE];
+	uint8_t seenHead_;
+	Link links_[MULTIRADIO_MAX_NODES];
+	uint8_t linkVictim_;
+	uint32_t duplicates_;
+};
+
+#endif
@@ -0,0 +1,30 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+
+#include "NodeDescriptor.h"
+
+bool nodeDescriptorChild(const uint8_t* blob, uint16_t length, uint8_t index,
+                         uint8_t* id, Sensor_type* type,
+                         const uint8_t** infos, uint8_t* infoCount) {
+  if (length < 2 || blob[0] != NODE_DESCRIPTOR_VERSION || index >= blob[1]) {
+    return false;
+  }
+  uint16_t pos = 2;
+  for (uint8_t i = 0; ; i++) {
+    if (pos + 3 > length || pos + 3 + blob[pos + 2] > length) {
+      return false;
+    }
+    if (i == index) {
+      *id = blob[pos];
+      *type = (Sensor_type)blob[pos + 1];
+      *infoCount = blob[pos + 2];
+      *infos = blob + pos + 3;
+      return true;
+    }
+    pos += 3 + blob[pos + 2];
+  }
+}
@@ -0,0 +1,85 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file NodeDescriptor.h
+ *
+ * @brief Node capability descriptor built at compile time
+ *
+ * The children of a node, their Sensor_type and their Sensor_information_type
+ * are described in the sketch with:
+ *
+ *     typedef NodeDescriptor<
+ *       ChildDescriptor<0, S_TEMP, V_TEMP>,
+ *       ChildDescriptor<1, S_DOOR, V_TRIPPED, V_ARMED>
+ *     > MyNode;
+ *
+ * MyNode::data is the binary blob in PROGMEM, MyNode::size its size and
+ * MyNode::hash its hash, all computed by the compiler. The blob is presented as
+ * the node functions list (see FunctionsList.h), so at boot the node sends only
+ * the announce and the gateway asks for the blob when it does not know the hash:
+ *
+ *     FunctionsListSender descriptor(MyNode::data, MyNode::size, MyNode::hash);
+ *
+ * Blob: version, child count, then for each child: id, Sensor_type, count of
+ * Sensor_information_type, the Sensor_information_type values.
+ */
+#ifndef NODEDESCRIPTOR_H
+#define NODEDESCRIPTOR_H
+
+#include <Arduino.h>
+#include "Message.h"
+#include "MessageHash.h"
+
+#define NODE_DESCRIPTOR_VERSION 1
+
+/// @brief A list of bytes known at compile time, stored in PROGMEM
+template <uint8_t... Bytes>
+struct DescriptorBytes {
+	static const uint16_t size = sizeof...(Bytes);
+	static constexpr uint32_t hash = messageHashBytes(MESSAGE_HASH_SEED, Bytes...);
+	static const uint8_t data[sizeof...(Bytes)];
+};
+
+template <uint8_t... Bytes>
+constexpr uint32_t DescriptorBytes<Bytes...>::hash;
+
+template <uint8_t... Bytes>
+const uint8_t DescriptorBytes<Bytes...>::data[sizeof...(Bytes)] PROGMEM = { Bytes... };
+
+template <typename... Lists>
+struct DescriptorConcat;
+
+template <uint8_t... Bytes>
+struct DescriptorConcat<DescriptorBytes<Bytes...> > {
+	typedef DescriptorBytes<Bytes...> type;
+};
+
+template <uint8_t... First, uint8_t... Second, typename... Rest>
+struct DescriptorConcat<DescriptorBytes<First...>, DescriptorBytes<Second...>, Rest...> {
+	typedef typename DescriptorConcat<DescriptorBytes<First..., Second...>, Rest...>::type type;
+};
+
+/// @brief One child of the node and the values it supports
+template <uint8_t Id, Sensor_type Type, Sensor_information_type... Infos>
+struct ChildDescriptor {
+	typedef DescriptorBytes<Id, (uint8_t)Type, (uint8_t)sizeof...(Infos), (uint8_t)Infos...> bytes;
+};
+
+/// @brief The whole node, see the file description
+template <typename... Children>
+struct NodeDescriptor : DescriptorConcat<
+		DescriptorBytes<NODE_DESCRIPTOR_VERSION, (uint8_t)sizeof...(Children)>,
+		typename Children::bytes...>::type {
+};
+
+/// @brief Reads child @p index of a descriptor blob (in RAM, as cached by the gateway)
+/// @return false if the blob is too short or has another version
+bool nodeDescriptorChild(const uint8_t* blob, uint16_t length, uint8_t index,
+                         uint8_t* id, Sensor_type* type,
+                         const uint8_t** infos, uint8_t* infoCount);
+
+#endif
@@ -0,0 +1,423 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+
+#include "NodeRegistry.h"
+#include "MessageHash.h"
+
+// Slot @p probe of the probe sequence of @p address: its own shard first, then the next ones
+static uint8_t probeSlot(uint16_t address, uint8_t probe) {
+  return (NodeRegistry::shardOf(address) * REGISTRY_SHARD_SIZE + probe) % REGISTRY_MAX_NODES;
+}
+
+//Constructor
+NodeRegistry::NodeRegistry() : version_(0), horizon_(0) {
+  for (uint8_t i = 0; i < REGISTRY_MAX_NODES; i++) {
+    nodes_[i].used = false;
+  }
+  for (uint8_t i = 0; i < REGISTRY_MAX_VALUES; i++) {
+    values_[i].used = false;
+    values_[i].version = 0;
+  }
+  memset(dirty_, 0, sizeof(dirty_));
+  memset(tombstones_, 0, sizeof(tombstones_));
+  memset(versions_, 0, sizeof(versions_));
+}
+
+// Marks a node as changed since the last snapshot and stamps it with a new version
+void NodeRegistry::touch(const RegistryNode* node) {
+  uint8_t index = node - nodes_;
+  dirty_[index >> 3] |= 1 << (index & 7);
+  versions_[index] = ++version_;
+}
+
+void NodeRegistry::setTombstone(uint8_t index, bool tombstone) {
+  if (tombstone) {
+    tombstones_[index >> 3] |= 1 << (index & 7);
+  } else {
+    tombstones_[index >> 3] &= ~(1 << (index & 7));
+  }
+}
+
+bool NodeRegistry::takeDirty(uint8_t index) {
+  uint8_t mask = 1 << (index & 7);
+  bool dirty = dirty_[index >> 3] & mask;
+  dirty_[index >> 3] &= ~mask;
+  return dirty;
+}
+
+const RegistryNode& NodeRegistry::slot(uint8_t index) const {
+  return nodes_[index];
+}
+
+void NodeRegistry::restoreSlot(uint8_t index, const RegistryNode& node) {
+  if (node.used) {
+    // The free slots the node is probed through must not end its search
+    for (uint8_t i = 0; i < REGISTRY_MAX_NODES && probeSlot(node.address, i) != index; i++) {
+      if (!nodes_[probeSlot(node.address, i)].used) {
+        setTombstone(probeSlot(node.address, i), true);
+      }
+    }
+    setTombstone(index, false);
+  } else if (nodes_[index].used) {
+    setTombstone(index, true);
+  }
+  nodes_[index] = node;
+  touch(&nodes_[index]);
+}
+
+uint16_t NodeRegistry::layout() {
+  uint16_t values[3] = { REGISTRY_MAX_NODES, REGISTRY_SHARDS, sizeof(RegistryNode) };
+  return (uint16_t)messageHash(values, sizeof(values));
+}
+
+uint32_t NodeRegistry::version() const {
+  return version_;
+}
+
+uint32_t NodeRegistry::slotVersion(uint8_t index) const {
+  return versions_[index];
+}
+
+uint32_t NodeRegistry::horizon() const {
+  return horizon_;
+}
+
+const RegistryValue& NodeRegistry::valueSlot(uint8_t index) const {
+  return values_[index];
+}
+
+// Multiplicative hash, the low bits of RF24Network addresses alone are too regular
+uint8_t NodeRegistry::shardOf(uint16_t address, uint8_t shards) {
+  return (uint8_t)((uint16_t)(address * 40503u) >> 8) % shards;
+}
+
+RegistryNode* NodeRegistry::findNode(uint16_t address) {
+  for (uint8_t i = 0; i < REGISTRY_MAX_NODES; i++) {
+    uint8_t index = probeSlot(address, i);
+    RegistryNode* node = &nodes_[index];
+    if (node->used && node->address == address) {
+      return node;
+    }
+    // A node is never placed after a slot never used
+    if (!node->used && !(tombstones_[index >> 3] & (1 << (index & 7)))) {
+      return NULL;
+    }
+  }
+  return NULL;
+}
+
+const RegistryNode* NodeRegistry::find(uint16_t address) const {
+  return const_cast<NodeRegistry*>(this)->findNode(address);
+}
+
+RegistryNode* NodeRegistry::addNode(uint16_t address) {
+  RegistryNode* node = findNode(address);
+  for (uint8_t i = 0; i < REGISTRY_MAX_NODES && node == NULL; i++) {
+    if (!nodes_[probeSlot(address, i)].used) {
+      node = &nodes_[probeSlot(address, i)];
+      // The removal the slot was keeping is lost
+      uint32_t removed = versions_[node - nodes_];
+      if (removed > horizon_) {
+        horizon_ = removed;
+      }
+      setTombstone(node - nodes_, false);
+      memset(node, 0, sizeof(RegistryNode));
+      node->used = true;
+      node->address = address;
+      node->metadataStale = true;
+      touch(node);
+    }
+  }
+  return node;
+}
+
+void NodeRegistry::remove(uint16_t address) {
+  RegistryNode* node = findNode(address);
+  if (node) {
+    node->used = false;
+    setTombstone(node - nodes_, true);
+    touch(node);
+  }
+  // The values stay as stamped free slots, so a delta sync tells they are gone
+  for (uint8_t i = 0; i < REGISTRY_MAX_VALUES; i++) {
+    if (values_[i].used && values_[i].address == address) {
+      values_[i].used = false;
+      values_[i].version = ++version_;
+    }
+  }
+}
+
+const RegistryChannel* NodeRegistry::findChannel(uint16_t address, uint8_t sensorId) const {
+  const RegistryNode* node = find(address);
+  if (node == NULL) {
+    return NULL;
+  }
+  for (uint8_t i = 0; i < REGISTRY_MAX_CHANNELS; i++) {
+    if (node->channels[i].used && node->channels[i].sensorId == sensorId) {
+      return &node->channels[i];
+    }
+  }
+  return NULL;
+}
+
+RegistryChannel* NodeRegistry::addChannel(RegistryNode& node, uint8_t sensorId) {
+  RegistryChannel* free = NULL;
+  for (uint8_t i = 0; i < REGISTRY_MAX_CHANNELS; i++) {
+    if (node.channels[i].used && node.channels[i].sensorId == sensorId) {
+      return &node.channels[i];
+    }
+    if (!node.channels[i].used && free == NULL) {
+      free = &node.channels[i];
+    }
+  }
+  if (free) {
+    memset(free, 0, sizeof(RegistryChannel));
+    free->used = true;
+    free->sensorId = sensorId;
+    free->sensorType = S_NONE_TYPE;
+  }
+  return free;
+}
+
+const char* NodeRegistry::unitPrefix(uint16_t address, uint8_t sensorId) const {
+  const RegistryChannel* channel = findChannel(address, sensorId);
+  return channel ? channel->unitPrefix : "";
+}
+
+// Copies a P_STRING payload (NUL terminated or filling the whole payload) into field
+Registry_result NodeRegistry::setText(RegistryNode& node, char* field, uint8_t size, const char* value) {
+  uint8_t length = 0;
+  while (length < size - 1 && length < MESSAGE_PAYLOAD_SIZE && value[length]) length++;
+  if (strncmp(field, value, length) == 0 && field[length] == '\0') {
+    return REG_UNCHANGED;
+  }
+  memcpy(field, value, length);
+  field[length] = '\0';
+  node.metadataVersion++;
+  touch(&node);
+  return REG_UPDATED;
+}
+
+Registry_result NodeRegistry::onMessage(const MessageHelper& msg) {
+  Sensor_command command = msg.getCommand();
+  const char* payload = msg.getPayload();
+  RegistryNode* node;
+
+  switch (command) {
+    case C_PRESENTATION_CHILDREN: {
+      node = addNode(msg.getSensorAddress());
+      RegistryChannel* channel = node ? addChannel(*node, msg.getSensorID()) : NULL;
+      if (channel == NULL) {
+        return REG_FULL;
+      }
+      if (channel->sensorType == msg.getSensorType()) {
+        return REG_UNCHANGED;
+      }
+      channel->sensorType = msg.getSensorType();
+      node->metadataVersion++;
+      touch(node);
+      return REG_UPDATED;
+    }
+
+    case C_SET:
+      if (msg.getSensorInformationType() != V_UNIT_PREFIX || msg.getPayloadType() != P_STRING) {
+        return cacheValue(msg);
+      }
+      node = addNode(msg.getSensorAddress());
+      if (node == NULL) {
+        return REG_FULL;
+      } else {
+        RegistryChannel* channel = addChannel(*node, msg.getSensorID());
+        if (channel == NULL) {
+          return REG_FULL;
+        }
+        return setText(*node, channel->unitPrefix, REGISTRY_UNIT_SIZE, payload);
+      }
+
+    case C_SYSTEM:
+      switch (msg.getSystemMessageType()) {
+        case I_SKETCH_NAME:
+          node = addNode(msg.getSensorAddress());
+          if (node == NULL) {
+            return REG_FULL;
+          }
+          // The node presents its metadata again, starting with its name
+          if (node->metadataStale) {
+            node->metadataStale = false;
+            touch(node);
+          }
+          return setText(*node, node->sketchName, REGISTRY_SKETCH_NAME_SIZE, payload);
+
+        case I_SKETCH_VERSION:
+          node = addNode(msg.getSensorAddress());
+          if (node == NULL) {
+            return REG_FULL;
+          }
+          return setText(*node, node->sketchVersion, REGISTRY_SKETCH_VERSION_SIZE, payload);
+
+        case I_SPECIAL_FUNCTIONSLIST: {
+          node = addNode(msg.getSensorAddress());
+          if (node == NULL) {
+            return REG_FULL;
+          }
+          const uint8_t* p = (const uint8_t*)payload;
+          uint32_t hash = (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+                          ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+          if (hash != node->descriptorHash) {
+            node->descriptorHash = hash;
+            node->metadataStale = true;
+            touch(node);
+          }
+          return node->metadataStale ? REG_METADATA_NEEDED : REG_UNCHANGED;
+        }
+
+        default:
+          return REG_IGNORED;
+      }
+
+    default:
+      return REG_IGNORED;
+  }
+}
+
+bool NodeRegistry::metadataRequest(uint16_t address, MessageHelper& request) const {
+  const RegistryNode* node = find(address);
+  if (node == NULL || !node->metadataStale) {
+    return false;
+  }
+  request.setSensorAddress(address);
+  request.setSensorID(0);
+  request.setCommand(C_REQ);
+  request.setSystemMessageType(I_PRESENTATION);
+  request.setPayloadType(P_HEARTBEAT);
+  return true;
+}
+
+bool NodeRegistry::setMaxAge(uint16_t address, uint8_t sensorId, uint16_t maxAge) {
+  RegistryNode* node = findNode(address);
+  for (uint8_t i = 0; node && i < REGISTRY_MAX_CHANNELS; i++) {
+    RegistryChannel& channel = node->channels[i];
+    if (channel.used && channel.sensorId == sensorId) {
+      if (channel.maxAge != maxAge) {
+        channel.maxAge = maxAge;
+        touch(node);
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+const RegistryValue* NodeRegistry::findValue(uint16_t address, uint8_t sensorId, Sensor_information_type type) const {
+  for (uint8_t i = 0; i < REGISTRY_MAX_VALUES; i++) {
+    const RegistryValue& v = values_[i];
+    if (v.used && v.address == address && v.sensorId == sensorId && v.type == type) {
+      return &v;
+    }
+  }
+  return NULL;
+}
+
+// Keeps the value reported by a child, in a free slot (the one removed first) or in place
+// of the oldest value when the cache is full
+Registry_result NodeRegistry::cacheValue(const MessageHelper& msg) {
+  Payload_type datatype = msg.getPayloadType();
+  const char* payload = msg.getPayload();
+  uint8_t length;
+  switch (datatype) {
+    case P_INT:
+    case P_UINT:
+      length = 2;
+      break;
+    case P_LONG32:
+    case P_ULONG32:
+    case P_FLOAT32:
+      length = 4;
+      break;
+    case P_BOOL:
+    case P_CHAR:
+    case P_UCHAR:
+    case P_BYNARY_BYTE:
+      length = 1;
+      break;
+    case P_STRING:
+      length = 0;
+      while (length <= REGISTRY_VALUE_SIZE && length < msg.getPayloadSize() && payload[length]) length++;
+      if (length > REGISTRY_VALUE_SIZE) {
+        return REG_IGNORED;
+      }
+      break;
+    default:
+      return REG_IGNORED;
+  }
+
+  uint16_t address = msg.getSensorAddress();
+  uint8_t sensorId = msg.getSensorID();
+  Sensor_information_type type = msg.getSensorInformationType();
+  RegistryValue* value = const_cast<RegistryValue*>(findValue(address, sensorId, type));
+  uint32_t now = millis();
+  // The removal of the same value, then the slot freed first
+  for (uint8_t i = 0; i < REGISTRY_MAX_VALUES && value == NULL; i++) {
+    RegistryValue& v = values_[i];
+    if (!v.used && v.version && v.address == address && v.sensorId == sensorId && v.type == type) {
+      value = &v;
+    }
+  }
+  if (value == NULL) {
+    for (uint8_t i = 0; i < REGISTRY_MAX_VALUES; i++) {
+      if (!values_[i].used && (value == NULL || values_[i].version < value->version)) {
+        value = &values_[i];
+      }
+    }
+    // The removal the slot was keeping is lost
+    if (value && value->version > horizon_) {
+      horizon_ = value->version;
+    }
+  }
+  if (value == NULL) {
+    value = &values_[0];
+    for (uint8_t i = 1; i < REGISTRY_MAX_VALUES; i++) {
+      if (now - values_[i].time > now - value->time) {
+        value = &values_[i];
+      }
+    }
+    // No removal can be stamped for the value dropped, older controllers need a full sync
+    horizon_ = version_ + 1;
+  }
+  value->address = address;
+  value->sensorId = sensorId;
+  value->used = true;
+  value->type = type;
+  value->datatype = datatype;
+  value->length = length;
+  value->time = now;
+  value->version = ++version_;
+  memcpy(value->value, payload, length);
+  return REG_VALUE;
+}
+
+bool NodeRegistry::answerRequest(const MessageHelper& request, MessageHelper& reply, bool bypass) const {
+  uint8_t length;
+  if (bypass || request.getCommand() != C_REQ || request.findExtension(X_NO_CACHE, &length)) {
+    return false;
+  }
+  const RegistryChannel* channel = findChannel(request.getSensorAddress(), request.getSensorID());
+  const RegistryValue* value = findValue(request.getSensorAddress(), request.getSensorID(),
+                                         request.getSensorInformationType());
+  if (channel == NULL || value == NULL || millis() - value->time >= channel->maxAge * 1000UL) {
+    return false;
+  }
+  reply.clearExtensions();
+  reply.setSensorAddress(value->address);
+  reply.setSensorID(value->sensorId);
+  reply.setCommand(C_SET);
+  reply.setSensorInformationType(value->type);
+  reply.setPayloadType(value->datatype);
+  memset(reply.getPayload(), 0, reply.getPayloadSize());
+  memcpy(reply.getPayload(), value->value, value->length);
+  return true;
+}
@@ -0,0 +1,198 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file NodeRegistry.h
+ *
+ * @brief Gateway side registry of the known nodes and of their metadata
+ *
+ * The registry keeps, for every node, its sketch name and version and, for
+ * every child, its Sensor_type and its V_UNIT_PREFIX. Nodes present this
+ * metadata once, and again only when the gateway asks for it: the gateway asks
+ * when the descriptor hash of the node (I_SPECIAL_FUNCTIONSLIST announce, see
+ * FunctionsList.h) changes. The metadata version of a node is bumped every time
+ * one of its metadata changes, so consumers know when to refresh their copy.
+ *
+ * The nodes are split in REGISTRY_SHARDS shards by a hash of their address. A
+ * node goes to its own shard, or to the next shard that has room when its own
+ * one is full, so the whole registry can be used whatever the addresses, and
+ * it is looked for in the same order up to the first slot never used. A slot
+ * freed by remove() stays a tombstone, so the nodes placed after it are still
+ * found. A gateway that runs several workers routes every frame with shardOf()
+ * and gives each worker its own NodeRegistry, so the state of a node is only
+ * touched by one worker.
+ *
+ * The last values reported by the nodes (C_SET) are cached, apart from the
+ * nodes so they are not persisted. A C_REQ is answered from the cache by
+ * answerRequest() when the value is younger than the max age of its channel
+ * (setMaxAge(), 0 by default: the requests always go to the node), unless the
+ * request carries the X_NO_CACHE extension.
+ *
+ * Every change of a node or of a cached value bumps the registry version and
+ * stamps the node or value with it, so a controller that knows the state at
+ * version N only needs what changed since (see RegistrySync.h). A removed node
+ * or value stays as a stamped free slot until the slot is reused; from then on
+ * the changes since a version older than horizon() cannot be told. A value
+ * evicted from a full cache leaves no slot, so it moves horizon() to the
+ * current version: REGISTRY_MAX_VALUES should hold the values of all nodes.
+ */
+#ifndef NODEREGISTRY_H
+#define NODEREGISTRY_H
+
+#include <Arduino.h>
+#include "Message.h"
+
+/// @brief Number of nodes the gateway keeps track of, fewer on the parts with 1 KB
+/// of EEPROM or less so a RegistrySnapshot fits
+#ifndef REGISTRY_MAX_NODES
+#if defined(E2END) && E2END < 0x7FF
+#define REGISTRY_MAX_NODES 4
+#else
+#define REGISTRY_MAX_NODES 16
+#endif
+#endif
+/// @brief Number of children per node (limit of RF24Network structure)
+#ifndef REGISTRY_MAX_CHANNELS
+#define REGISTRY_MAX_CHANNELS 5
+#endif
+/// @brief Number of shards the nodes are split in, must divide REGISTRY_MAX_NODES
+#ifndef REGISTRY_SHARDS
+#define REGISTRY_SHARDS 4
+#endif
+#if REGISTRY_MAX_NODES % REGISTRY_SHARDS
+#error "REGISTRY_SHARDS must divide REGISTRY_MAX_NODES"
+#endif
+#define REGISTRY_SHARD_SIZE (REGISTRY_MAX_NODES / REGISTRY_SHARDS)
+
+#ifndef REGISTRY_UNIT_SIZE
+#define REGISTRY_UNIT_SIZE 8
+#endif
+#ifndef REGISTRY_SKETCH_NAME_SIZE
+#define REGISTRY_SKETCH_NAME_SIZE 16
+#endif
+#ifndef REGISTRY_SKETCH_VERSION_SIZE
+#define REGISTRY_SKETCH_VERSION_SIZE 8
+#endif
+/// @brief Number of values cached
+#ifndef REGISTRY_MAX_VALUES
+#define REGISTRY_MAX_VALUES 16
+#endif
+/// @brief Largest value cached (longer strings are not)
+#ifndef REGISTRY_VALUE_SIZE
+#define REGISTRY_VALUE_SIZE 8
+#endif
+
+/// @brief Result of NodeRegistry::onMessage()
+typedef enum : unsigned char {
+	REG_IGNORED				= 0,	//!< The message carries nothing the registry keeps
+	REG_UNCHANGED			= 1,	//!< The registry already had this information
+	REG_UPDATED				= 2,	//!< The registry has been updated
+	REG_METADATA_NEEDED		= 3,	//!< The node descriptor changed, send metadataRequest()
+	REG_FULL				= 4,	//!< No room left for this node or child
+	REG_VALUE				= 5		//!< The value has been cached
+} Registry_result;
+
+/// @brief A child of a node
+typedef struct {
+	uint8_t sensorId;
+	bool used;
+	Sensor_type sensorType;
+	uint16_t maxAge;	// s, a C_REQ is answered from a value younger than that
+	char unitPrefix[REGISTRY_UNIT_SIZE];
+} RegistryChannel;
+
+/// @brief A value reported by a child
+typedef struct {
+	uint16_t address;
+	uint8_t sensorId;
+	bool used;
+	Sensor_information_type type;
+	Payload_type datatype;
+	uint8_t length;
+	uint32_t time;	// millis() of the report
+	uint32_t version;
+	char value[REGISTRY_VALUE_SIZE];
+} RegistryValue;
+
+/// @brief A node
+typedef struct {
+	uint16_t address;
+	bool used;
+	bool metadataStale;
+	uint8_t metadataVersion;
+	uint32_t descriptorHash;
+	char sketchName[REGISTRY_SKETCH_NAME_SIZE];
+	char sketchVersion[REGISTRY_SKETCH_VERSION_SIZE];
+	RegistryChannel channels[REGISTRY_MAX_CHANNELS];
+} RegistryNode;
+
+
+class NodeRegistry {
+
+ public:
+	NodeRegistry();
+	/// @brief Updates the registry from a message received from a node
+	Registry_result onMessage(const MessageHelper& msg);
+	/// @brief Builds the C_REQ / I_PRESENTATION asking @p address to present its metadata again
+	/// @return false if the metadata of the node is up to date
+	bool metadataRequest(uint16_t address, MessageHelper& request) const;
+
+	const RegistryNode* find(uint16_t address) const;
+	const RegistryChannel* findChannel(uint16_t address, uint8_t sensorId) const;
+	/// @brief Unit prefix of a child, "" if unknown
+	const char* unitPrefix(uint16_t address, uint8_t sensorId) const;
+	void remove(uint16_t address);
+
+	/// @brief Sets how old, in s, a cached value of a child may be to answer a C_REQ
+	/// @return false if the child is unknown
+	bool setMaxAge(uint16_t address, uint8_t sensorId, uint16_t maxAge);
+	const RegistryValue* findValue(uint16_t address, uint8_t sensorId, Sensor_information_type type) const;
+	/// @brief Builds in @p reply the C_SET answering a C_REQ from the cache
+	/// @param bypass true to send the request to the node whatever the cache holds
+	/// @return false if the request must be forwarded to the node
+	bool answerRequest(const MessageHelper& request, MessageHelper& reply, bool bypass = false) const;
+
+	/// @brief Shard that owns @p address, out of @p shards
+	static uint8_t shardOf(uint16_t address, uint8_t shards = REGISTRY_SHARDS);
+
+	/// @brief Raw slot access for persistence (see RegistrySnapshot.h)
+	const RegistryNode& slot(uint8_t index) const;
+	/// @brief Overwrites a slot, which counts as a change (dirty, new version)
+	void restoreSlot(uint8_t index, const RegistryNode& node);
+	/// @brief Identifies the layout of the slots, a slot can only be restored
+	/// from a registry built with the same one
+	static uint16_t layout();
+	/// @brief Returns whether the slot changed since the last call, and clears the flag
+	bool takeDirty(uint8_t index);
+
+	/// @brief Version of the last change
+	uint32_t version() const;
+	/// @brief Version of the last change of a slot, used or not
+	uint32_t slotVersion(uint8_t index) const;
+	/// @brief Oldest version the changes can be given from
+	uint32_t horizon() const;
+	const RegistryValue& valueSlot(uint8_t index) const;
+
+ private:
+	RegistryNode* findNode(uint16_t address);
+	RegistryNode* addNode(uint16_t address);
+	RegistryChannel* addChannel(RegistryNode& node, uint8_t sensorId);
+	Registry_result setText(RegistryNode& node, char* field, uint8_t size, const char* value);
+	void touch(const RegistryNode* node);
+	void setTombstone(uint8_t index, bool tombstone);
+
+	Registry_result cacheValue(const MessageHelper& msg);
+
+	RegistryNode nodes_[REGISTRY_MAX_NODES];
+	RegistryValue values_[REGISTRY_MAX_VALUES];
+	uint8_t dirty_[(REGISTRY_MAX_NODES + 7) / 8];
+	uint8_t tombstones_[(REGISTRY_MAX_NODES + 7) / 8];
+	uint32_t versions_[REGISTRY_MAX_NODES];
+	uint32_t version_;
+	uint32_t horizon_;
+};
+
+#endif
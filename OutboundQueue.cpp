@@ -0,0 +1,136 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+
+#include "OutboundQueue.h"
+
+// The lock may be taken from an interrupt handler or with interrupts already
+// disabled, so it restores the previous state rather than enabling them
+#if defined(__AVR__)
+#define OUTBOUND_LOCK() uint8_t sreg = SREG; cli()
+#define OUTBOUND_UNLOCK() SREG = sreg
+#elif defined(__arm__)
+#define OUTBOUND_LOCK() uint32_t primask = __get_PRIMASK(); __disable_irq()
+#define OUTBOUND_UNLOCK() __set_PRIMASK(primask)
+#elif defined(ESP8266)
+#define OUTBOUND_LOCK() uint32_t level = xt_rsil(15)
+#define OUTBOUND_UNLOCK() xt_wsr_ps(level)
+#else
+// No way to read the interrupt state, the queue must not be used with interrupts disabled
+#define OUTBOUND_LOCK() noInterrupts()
+#define OUTBOUND_UNLOCK() interrupts()
+#endif
+
+//Constructor
+OutboundQueue::OutboundQueue() {
+  free_ = OUTBOUND_POOL_SIZE == 32 ? 0xFFFFFFFFUL : (1UL << OUTBOUND_POOL_SIZE) - 1;
+  for (uint8_t i = 0; i < OUT_PRIORITIES; i++) {
+    head_[i] = 0;
+    count_[i] = 0;
+  }
+  coalesced_ = 0;
+  sequence_ = 0;
+}
+
+int8_t OutboundQueue::acquire() {
+  int8_t handle = -1;
+  OUTBOUND_LOCK();
+  for (uint8_t i = 0; i < OUTBOUND_POOL_SIZE; i++) {
+    if (free_ & (1UL << i)) {
+      free_ &= ~(1UL << i);
+      handle = i;
+      break;
+    }
+  }
+  OUTBOUND_UNLOCK();
+  return handle;
+}
+
+MessageHelper& OutboundQueue::message(int8_t handle) {
+  return pool_[handle];
+}
+
+uint16_t OutboundQueue::destination(int8_t handle) const {
+  return to_[handle];
+}
+
+void OutboundQueue::commit(int8_t handle, uint16_t to, Outbound_priority priority) {
+  if (handle < 0 || handle >= OUTBOUND_POOL_SIZE) {
+    return;
+  }
+  if (priority >= OUT_PRIORITIES) {
+    priority = OUT_NORMAL;
+  }
+  to_[handle] = to;
+  // A priority ring has as many slots as the pool, it cannot overflow
+  OUTBOUND_LOCK();
+  seq_[handle] = sequence_++;
+  ring_[priority][(head_[priority] + count_[priority]) % OUTBOUND_POOL_SIZE] = handle;
+  count_[priority]++;
+  OUTBOUND_UNLOCK();
+}
+
+void OutboundQueue::release(int8_t handle) {
+  if (handle < 0 || handle >= OUTBOUND_POOL_SIZE) {
+    return;
+  }
+  OUTBOUND_LOCK();
+  free_ |= 1UL << handle;
+  OUTBOUND_UNLOCK();
+}
+
+// Commit order, not batch order: a high priority C_SET may be older than a normal one
+bool OutboundQueue::supersedes(int8_t newer, int8_t older) const {
+  const MessageHelper& a = pool_[newer];
+  const MessageHelper& b = pool_[older];
+  return (int16_t)(seq_[newer] - seq_[older]) > 0 &&
+         a.getCommand() == C_SET && b.getCommand() == C_SET &&
+         to_[newer] == to_[older] &&
+         a.getSensorAddress() == b.getSensorAddress() &&
+         a.getSensorID() == b.getSensorID() &&
+         a.getSensorInformationType() == b.getSensorInformationType();
+}
+
+uint8_t OutboundQueue::dequeueBatch(int8_t* handles, uint8_t max) {
+  uint8_t n = 0;
+  OUTBOUND_LOCK();
+  for (uint8_t p = 0; p < OUT_PRIORITIES; p++) {
+    while (count_[p] && n < max) {
+      handles[n++] = ring_[p][head_[p]];
+      head_[p] = (head_[p] + 1) % OUTBOUND_POOL_SIZE;
+      count_[p]--;
+    }
+  }
+  OUTBOUND_UNLOCK();
+
+  // Coalescing, outside of the critical section
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < n; i++) {
+    bool stale = false;
+    for (uint8_t j = 0; j < n && !stale; j++) {
+      stale = supersedes(handles[j], handles[i]);
+    }
+    if (stale) {
+      release(handles[i]);
+      coalesced_++;
+    } else {
+      handles[kept++] = handles[i];
+    }
+  }
+  return kept;
+}
+
+uint8_t OutboundQueue::pending() const {
+  uint8_t n = 0;
+  for (uint8_t p = 0; p < OUT_PRIORITIES; p++) {
+    n += count_[p];
+  }
+  return n;
+}
+
+uint16_t OutboundQueue::coalesced() const {
+  return coalesced_;
+}
@@ -0,0 +1,77 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file OutboundQueue.h
+ *
+ * @brief Bounded queue of pooled outbound messages for the radio
+ *
+ * Producers (controller link, rules, OTA, mailbox, interrupt handlers) take a
+ * handle from the pool with acquire(), fill message(handle) in place and
+ * commit() it with a destination and a priority. The radio side takes a batch
+ * of handles with dequeueBatch(), high priority first, transmits them and
+ * gives them back with release(). Only the index updates run with interrupts
+ * disabled (a few instructions), messages are never copied.
+ *
+ * Inside a batch, a C_SET for the same node, child and value type as one
+ * committed later is dropped, whatever their priorities: only the latest value
+ * is sent.
+ */
+#ifndef OUTBOUNDQUEUE_H
+#define OUTBOUNDQUEUE_H
+
+#include <Arduino.h>
+#include "Message.h"
+
+/// @brief Number of messages in the pool (max 32)
+#ifndef OUTBOUND_POOL_SIZE
+#define OUTBOUND_POOL_SIZE 8
+#endif
+#if OUTBOUND_POOL_SIZE > 32
+#error "OUTBOUND_POOL_SIZE must not exceed 32"
+#endif
+
+typedef enum : unsigned char {
+	OUT_HIGH				= 0,	//!< Replies and alerts, sent first
+	OUT_NORMAL				= 1,	//!< Everything else
+	OUT_PRIORITIES			= 2
+} Outbound_priority;
+
+
+class OutboundQueue {
+
+ public:
+	OutboundQueue();
+	/// @return a free handle, -1 if the pool is empty
+	int8_t acquire();
+	MessageHelper& message(int8_t handle);
+	uint16_t destination(int8_t handle) const;
+	/// @brief Queues a message filled through message(handle)
+	void commit(int8_t handle, uint16_t to, Outbound_priority priority = OUT_NORMAL);
+	/// @brief Gives a handle back to the pool, after transmission or to cancel it
+	void release(int8_t handle);
+	/// @brief Takes up to @p max queued handles, high priority first, in commit order
+	/// @return number of handles written to @p handles
+	uint8_t dequeueBatch(int8_t* handles, uint8_t max);
+	uint8_t pending() const;
+	/// @brief Number of C_SET dropped because a newer value was queued
+	uint16_t coalesced() const;
+
+ private:
+	bool supersedes(int8_t newer, int8_t older) const;
+
+	MessageHelper pool_[OUTBOUND_POOL_SIZE];
+	uint16_t to_[OUTBOUND_POOL_SIZE];
+	uint16_t seq_[OUTBOUND_POOL_SIZE];	// commit order
+	volatile uint32_t free_;
+	int8_t ring_[OUT_PRIORITIES][OUTBOUND_POOL_SIZE];
+	volatile uint8_t head_[OUT_PRIORITIES];
+	volatile uint8_t count_[OUT_PRIORITIES];
+	uint16_t coalesced_;
+	uint16_t sequence_;
+};
+
+#endif
@@ -0,0 +1,215 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+
+#include "PayloadParser.h"
+
+#if !defined(__AVR__) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) && \
+    defined(__SIZEOF_POINTER__) && (__SIZEOF_POINTER__ == 8)
+#define PAYLOAD_PARSER_SWAR
+#endif
+
+static bool isDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+static uint8_t skipSpaces(const char* text, uint8_t length, uint8_t pos) {
+  while (pos < length && text[pos] == ' ') pos++;
+  return pos;
+}
+
+static uint8_t readSign(const char* text, uint8_t length, uint8_t pos, bool* negative) {
+  *negative = false;
+  if (pos < length && (text[pos] == '-' || text[pos] == '+')) {
+    *negative = text[pos] == '-';
+    pos++;
+  }
+  return pos;
+}
+
+#ifdef PAYLOAD_PARSER_SWAR
+// Converts 8 ASCII digits with a few 64 bit operations, false if one is not a digit
+static bool readEightDigits(const char* text, uint32_t* value) {
+  uint64_t v;
+  memcpy(&v, text, sizeof(v));
+  if ((v & 0xF0F0F0F0F0F0F0F0ULL) != 0x3030303030303030ULL ||
+      ((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) != 0x3030303030303030ULL) {
+    return false;
+  }
+  v -= 0x3030303030303030ULL;
+  v = (v * 10) + (v >> 8);
+  v = (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+       (((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+  *value = (uint32_t)v;
+  return true;
+}
+#endif
+
+// Reads the digits at pos, sets overflow if the value goes over limit (the digits are still consumed)
+static uint8_t readDigits(const char* text, uint8_t length, uint8_t pos, uint32_t limit,
+                          uint32_t* value, bool* overflow) {
+  uint32_t v = 0;
+  *overflow = false;
+#ifdef PAYLOAD_PARSER_SWAR
+  uint32_t block;
+  while (length - pos >= 8 && readEightDigits(text + pos, &block)) {
+    uint64_t next = (uint64_t)v * 100000000ULL + block;
+    if (next > limit) {
+      *overflow = true;
+    } else {
+      v = (uint32_t)next;
+    }
+    pos += 8;
+  }
+#endif
+  for (; pos < length && isDigit(text[pos]); pos++) {
+    uint8_t digit = text[pos] - '0';
+    if (v > (limit - digit) / 10) {
+      *overflow = true;
+    } else {
+      v = v * 10 + digit;
+    }
+  }
+  *value = v;
+  return pos;
+}
+
+Parse_result parseUInt32(const char* text, uint8_t length, uint32_t* value, uint8_t* used) {
+  uint8_t start = skipSpaces(text, length, 0);
+  if (start < length && text[start] == '+') {
+    start++;
+  }
+  bool overflow;
+  uint8_t end = readDigits(text, length, start, 0xFFFFFFFFUL, value, &overflow);
+  if (used) *used = end == start ? 0 : end;
+  if (end == start) return PARSE_EMPTY;
+  return overflow ? PARSE_OVERFLOW : PARSE_OK;
+}
+
+Parse_result parseInt32(const char* text, uint8_t length, int32_t* value, uint8_t* used) {
+  bool negative;
+  uint8_t start = readSign(text, length, skipSpaces(text, length, 0), &negative);
+  bool overflow;
+  uint32_t magnitude;
+  uint8_t end = readDigits(text, length, start, negative ? 0x80000000UL : 0x7FFFFFFFUL, &magnitude, &overflow);
+  if (used) *used = end == start ? 0 : end;
+  if (end == start) return PARSE_EMPTY;
+  *value = negative ? (int32_t)(0U - magnitude) : (int32_t)magnitude;
+  return overflow ? PARSE_OVERFLOW : PARSE_OK;
+}
+
+Parse_result parseFixed(const char* text, uint8_t length, uint8_t decimals, int32_t* value, uint8_t* used) {
+  bool negative;
+  uint8_t start = readSign(text, length, skipSpaces(text, length, 0), &negative);
+  uint32_t limit = negative ? 0x80000000UL : 0x7FFFFFFFUL;
+  bool overflow;
+  uint32_t magnitude;
+  uint8_t pos = readDigits(text, length, start, limit, &magnitude, &overflow);
+  bool digits = pos > start;
+
+  bool fraction = pos < length && text[pos] == '.';
+  if (fraction) {
+    pos++;
+  }
+  bool roundUp = false;
+  for (uint8_t i = 0; i < decimals || (fraction && pos < length && isDigit(text[pos])); i++) {
+    uint8_t digit = 0;
+    if (fraction && pos < length && isDigit(text[pos])) {
+      digit = text[pos++] - '0';
+      digits = true;
+    }
+    if (i == decimals) {
+      // First digit past the precision rounds, the next ones are skipped
+      roundUp = digit >= 5;
+      while (pos < length && isDigit(text[pos])) pos++;
+      break;
+    }
+    if (magnitude > (limit - digit) / 10) {
+      overflow = true;
+    } else {
+      magnitude = magnitude * 10 + digit;
+    }
+  }
+  if (roundUp) {
+    if (magnitude == limit) {
+      overflow = true;
+    } else {
+      magnitude++;
+    }
+  }
+
+  if (used) *used = digits ? pos : 0;
+  if (!digits) return PARSE_EMPTY;
+  *value = negative ? (int32_t)(0U - magnitude) : (int32_t)magnitude;
+  return overflow ? PARSE_OVERFLOW : PARSE_OK;
+}
+
+// Multiplies by 10^exponent with at most 6 float multiplications
+static float scale10(float value, int16_t exponent) {
+  static const float powers[] = { 1e1f, 1e2f, 1e4f, 1e8f, 1e16f, 1e32f };
+  bool divide = exponent < 0;
+  uint16_t e = divide ? -exponent : exponent;
+  for (uint8_t i = 0; i < 6 && e; i++, e >>= 1) {
+    if (e & 1) {
+      value = divide ? value / powers[i] : value * powers[i];
+    }
+  }
+  if (e) {
+    value = divide ? 0.0f : value * 1e32f * 1e32f;
+  }
+  return value;
+}
+
+Parse_result parseFloat(const char* text, uint8_t length, float* value, uint8_t* used) {
+  bool negative;
+  uint8_t pos = readSign(text, length, skipSpaces(text, length, 0), &negative);
+  // Up to 9 significant digits fit the mantissa, more only move the exponent
+  uint32_t mantissa = 0;
+  uint8_t significant = 0;
+  int16_t exponent = 0;
+  bool digits = false;
+  bool fraction = false;
+  for (; pos < length; pos++) {
+    char c = text[pos];
+    if (c == '.' && !fraction) {
+      fraction = true;
+      continue;
+    }
+    if (!isDigit(c)) {
+      break;
+    }
+    digits = true;
+    if (significant < 9) {
+      mantissa = mantissa * 10 + (c - '0');
+      if (mantissa) significant++;
+      if (fraction) exponent--;
+    } else if (!fraction) {
+      exponent++;
+    }
+  }
+  if (!digits) {
+    if (used) *used = 0;
+    return PARSE_EMPTY;
+  }
+
+  if (pos < length && (text[pos] == 'e' || text[pos] == 'E')) {
+    bool expNegative;
+    uint8_t expStart = readSign(text, length, pos + 1, &expNegative);
+    bool overflow;
+    uint32_t e;
+    uint8_t expEnd = readDigits(text, length, expStart, 999, &e, &overflow);
+    if (expEnd > expStart) {
+      if (overflow) e = 999;
+      exponent += expNegative ? -(int16_t)e : (int16_t)e;
+      pos = expEnd;
+    }
+  }
+
+  float result = scale10((float)mantissa, exponent);
+  if (used) *used = pos;
+  *value = negative ? -result : result;
+  return result > 3.40282347e38f ? PARSE_OVERFLOW : PARSE_OK;
+}
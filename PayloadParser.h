@@ -0,0 +1,41 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file PayloadParser.h
+ *
+ * @brief Numeric parsing of P_STRING payloads without atoi/atol/atof
+ *
+ * The parsers read at most @p length characters and stop at the first character
+ * that is not part of the number (a NUL, a ';' separator...), so they work on
+ * getPayload() with length MESSAGE_PAYLOAD_SIZE, terminated or not. @p used
+ * (optional) gives the number of characters read, to parse the next field.
+ * Leading spaces and a sign are accepted. The float parser does not use the
+ * libc float parsing. On 64 bit little endian hosts the digits are converted
+ * 8 at a time.
+ */
+#ifndef PAYLOADPARSER_H
+#define PAYLOADPARSER_H
+
+#include <Arduino.h>
+#include "Message.h"
+
+/// @brief Result of the payload parsers
+typedef enum : unsigned char {
+	PARSE_OK				= 0,	//!< A number has been read
+	PARSE_EMPTY				= 1,	//!< No digit found
+	PARSE_OVERFLOW			= 2		//!< The number does not fit in the result type
+} Parse_result;
+
+Parse_result parseInt32(const char* text, uint8_t length, int32_t* value, uint8_t* used = NULL);
+Parse_result parseUInt32(const char* text, uint8_t length, uint32_t* value, uint8_t* used = NULL);
+/// @brief Parses a decimal number as a fixed point value with @p decimals decimals
+/// ("21.57" with 1 decimal gives 216, rounded half away from zero)
+Parse_result parseFixed(const char* text, uint8_t length, uint8_t decimals, int32_t* value, uint8_t* used = NULL);
+/// @brief Parses a decimal number with an optional exponent ("1.5", "-2e3")
+Parse_result parseFloat(const char* text, uint8_t length, float* value, uint8_t* used = NULL);
+
+#endif
@@ -0,0 +1,126 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+
+#include "RateLimiter.h"
+#include "PayloadParser.h"
+
+// Tokens of one message: a bucket gains perMinute tokens per ms
+#define RATE_TOKEN 60000UL
+
+//Constructor
+RateLimiter::RateLimiter() {
+  setLimit(RATE_CONTROL, 30, 10);
+  setLimit(RATE_DATA, 60, 10);
+  setLimit(RATE_BULK, 1200, 32);
+  for (uint8_t i = 0; i < RATE_LIMITER_NODES; i++) {
+    buckets_[i].used = false;
+  }
+}
+
+void RateLimiter::setLimit(Rate_class rateClass, uint16_t perMinute, uint8_t burst) {
+  perMinute_[rateClass] = perMinute;
+  burst_[rateClass] = burst;
+}
+
+Rate_class RateLimiter::classOf(Sensor_command command) {
+  switch (command) {
+    case C_SET:
+    case C_REQ:
+    case C_ACK:
+      return RATE_DATA;
+    case C_STREAM:
+      return RATE_BULK;
+    default:
+      return RATE_CONTROL;
+  }
+}
+
+// Finds the bucket of address, or takes the free or least recently used slot of its probes
+RateLimiter::Bucket* RateLimiter::bucket(uint16_t address, uint32_t now) {
+  uint8_t start = (uint16_t)(address * 40503u) >> 8;
+  Bucket* victim = NULL;
+  for (uint8_t i = 0; i < RATE_LIMITER_PROBES; i++) {
+    Bucket* b = &buckets_[(start + i) & (RATE_LIMITER_NODES - 1)];
+    if (b->used && b->address == address) {
+      return b;
+    }
+    if (!b->used) {
+      if (victim == NULL || victim->used) victim = b;
+    } else if (victim == NULL || (victim->used && now - b->last > now - victim->last)) {
+      victim = b;
+    }
+  }
+  victim->address = address;
+  victim->used = true;
+  victim->offending = false;
+  victim->dropped = 0;
+  victim->last = now;
+  for (uint8_t c = 0; c < RATE_CLASSES; c++) {
+    victim->tokens[c] = burst_[c] * RATE_TOKEN;
+  }
+  return victim;
+}
+
+Rate_result RateLimiter::admit(const MessageHelper& msg) {
+  uint32_t now = millis();
+  Bucket* b = bucket(msg.getSensorAddress(), now);
+  uint32_t elapsed = now - b->last;
+  b->last = now;
+  for (uint8_t c = 0; c < RATE_CLASSES; c++) {
+    uint32_t full = burst_[c] * RATE_TOKEN;
+    if (perMinute_[c] && elapsed >= full / perMinute_[c]) {
+      b->tokens[c] = full;
+    } else {
+      b->tokens[c] += elapsed * perMinute_[c];
+      if (b->tokens[c] > full) b->tokens[c] = full;
+    }
+  }
+
+  Rate_class rateClass = classOf(msg.getCommand());
+  if (b->tokens[rateClass] >= RATE_TOKEN) {
+    b->tokens[rateClass] -= RATE_TOKEN;
+    return RATE_PASS;
+  }
+  b->offending = true;
+  if (b->dropped < 0xFFFF) b->dropped++;
+  return msg.getCommand() == C_SET ? RATE_COALESCE : RATE_DROP;
+}
+
+bool RateLimiter::takeOffender(uint16_t* address, uint16_t* dropped) {
+  for (uint8_t i = 0; i < RATE_LIMITER_NODES; i++) {
+    Bucket& b = buckets_[i];
+    if (b.used && b.offending) {
+      *address = b.address;
+      *dropped = b.dropped;
+      b.offending = false;
+      b.dropped = 0;
+      return true;
+    }
+  }
+  return false;
+}
+
+void RateLimiter::rateConfig(uint16_t address, MessageHelper& msg) const {
+  msg.clearExtensions();
+  msg.setSensorAddress(address);
+  msg.setSensorID(0);
+  msg.setCommand(C_SYSTEM);
+  msg.setSystemMessageType(I_CONFIG);
+  msg.setPayloadType(P_STRING);
+  snprintf_P(msg.getPayload(), msg.getPayloadSize(), PSTR("R%u"), (unsigned)perMinute_[RATE_DATA]);
+}
+
+bool RateLimiter::parseRateConfig(const MessageHelper& msg, uint16_t* perMinute) {
+  const char* payload = msg.getPayload();
+  uint32_t value;
+  if (msg.getCommand() != C_SYSTEM || msg.getSystemMessageType() != I_CONFIG || payload[0] != 'R' ||
+      parseUInt32(payload + 1, msg.getPayloadSize() - 1, &value) != PARSE_OK || value > 0xFFFF) {
+    return false;
+  }
+  *perMinute = value;
+  return true;
+}
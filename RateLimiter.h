@@ -0,0 +1,88 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file RateLimiter.h
+ *
+ * @brief Per node token buckets, checked first thing when a message comes in
+ *
+ * Every node has one bucket per message class, refilled at perMinute messages
+ * a minute up to burst messages. admit() costs a hash of the address and at
+ * most RATE_LIMITER_PROBES slots; when they are all taken the least recently
+ * heard node gives its slot up. A message over the limit is dropped, a C_SET
+ * over the limit is coalesced: the caller keeps its value (in the NodeRegistry
+ * cache for instance) but does not forward it. A node going over its limit is
+ * reported once by takeOffender(), and rateConfig() builds the I_CONFIG that
+ * asks the node to slow down (read on the node by parseRateConfig()).
+ */
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#include <Arduino.h>
+#include "Message.h"
+
+/// @brief Number of nodes tracked, power of 2
+#ifndef RATE_LIMITER_NODES
+#define RATE_LIMITER_NODES 16
+#endif
+#if RATE_LIMITER_NODES & (RATE_LIMITER_NODES - 1)
+#error "RATE_LIMITER_NODES must be a power of 2"
+#endif
+/// @brief Slots looked at for an address
+#ifndef RATE_LIMITER_PROBES
+#define RATE_LIMITER_PROBES 4
+#endif
+
+/// @brief Message classes, each one has its own limit
+typedef enum : unsigned char {
+	RATE_CONTROL			= 0,	//!< C_PRESENTATION_*, C_SYSTEM
+	RATE_DATA				= 1,	//!< C_SET, C_REQ, C_ACK
+	RATE_BULK				= 2		//!< C_STREAM
+} Rate_class;
+#define RATE_CLASSES 3
+
+/// @brief Result of RateLimiter::admit()
+typedef enum : unsigned char {
+	RATE_PASS				= 0,	//!< Under the limit
+	RATE_COALESCE			= 1,	//!< Over the limit, keep the value but do not forward it
+	RATE_DROP				= 2		//!< Over the limit, drop the message
+} Rate_result;
+
+
+class RateLimiter {
+
+ public:
+	RateLimiter();
+	/// @brief Sets the limit of a class for all the nodes
+	void setLimit(Rate_class rateClass, uint16_t perMinute, uint8_t burst);
+	Rate_result admit(const MessageHelper& msg);
+	/// @brief Gives a node that went over a limit since it was last reported
+	/// @return false if there is none
+	bool takeOffender(uint16_t* address, uint16_t* dropped);
+	/// @brief Builds the C_SYSTEM / I_CONFIG giving @p address its C_SET limit ("R<perMinute>")
+	void rateConfig(uint16_t address, MessageHelper& msg) const;
+	/// @brief Reads the C_SET limit sent by rateConfig()
+	static bool parseRateConfig(const MessageHelper& msg, uint16_t* perMinute);
+	static Rate_class classOf(Sensor_command command);
+
+ private:
+	typedef struct {
+		uint16_t address;
+		bool used;
+		bool offending;
+		uint16_t dropped;
+		uint32_t last;
+		uint32_t tokens[RATE_CLASSES];	// 60000 per message
+	} Bucket;
+
+	Bucket* bucket(uint16_t address, uint32_t now);
+
+	uint16_t perMinute_[RATE_CLASSES];
+	uint8_t burst_[RATE_CLASSES];
+	Bucket buckets_[RATE_LIMITER_NODES];
+};
+
+#endif
@@ -0,0 +1,166 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+
+#include "RegistryMerkle.h"
+
+static void putHash(uint8_t* p, uint32_t hash) {
+  p[0] = (uint8_t)hash;
+  p[1] = (uint8_t)(hash >> 8);
+  p[2] = (uint8_t)(hash >> 16);
+  p[3] = (uint8_t)(hash >> 24);
+}
+
+static uint32_t getHash(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t textHash(const char* text, uint32_t hash) {
+  return messageHash(text, strlen(text) + 1, hash);
+}
+
+//Constructor
+RegistryMerkle::RegistryMerkle(const NodeRegistry& registry) : registry_(registry), version_(0) {
+  memset(tree_, 0, sizeof(tree_));
+  memset(slotHash_, 0, sizeof(slotHash_));
+  memset(slotLeaf_, 0, sizeof(slotLeaf_));
+  for (uint8_t i = MERKLE_LEAVES - 1; i > 0; i--) {
+    uint8_t children[8];
+    putHash(children, tree_[2 * i]);
+    putHash(children + 4, tree_[2 * i + 1]);
+    tree_[i] = messageHash(children, sizeof(children));
+  }
+  update();
+}
+
+bool RegistryMerkle::isLeaf(uint8_t index) {
+  return index >= MERKLE_LEAVES && index < 2 * MERKLE_LEAVES;
+}
+
+uint8_t RegistryMerkle::leafOf(uint16_t address) {
+  if (address >= MERKLE_ADDRESS_SPAN) {
+    address = MERKLE_ADDRESS_SPAN - 1;
+  }
+  return MERKLE_LEAVES + (uint32_t)address * MERKLE_LEAVES / MERKLE_ADDRESS_SPAN;
+}
+
+void RegistryMerkle::leafRange(uint8_t index, uint16_t* first, uint16_t* last) {
+  uint8_t leaf = index - MERKLE_LEAVES;
+  *first = ((uint32_t)leaf * MERKLE_ADDRESS_SPAN + MERKLE_LEAVES - 1) / MERKLE_LEAVES;
+  *last = leaf == MERKLE_LEAVES - 1 ? 0xFFFF :
+          ((uint32_t)(leaf + 1) * MERKLE_ADDRESS_SPAN + MERKLE_LEAVES - 1) / MERKLE_LEAVES - 1;
+}
+
+// The fields the nodes present, not the local state (metadata version, stale flag)
+uint32_t RegistryMerkle::nodeHash(const RegistryNode& node) {
+  uint8_t header[6];
+  header[0] = (uint8_t)node.address;
+  header[1] = (uint8_t)(node.address >> 8);
+  putHash(header + 2, node.descriptorHash);
+  uint32_t hash = messageHash(header, sizeof(header));
+  hash = textHash(node.sketchName, hash);
+  hash = textHash(node.sketchVersion, hash);
+  for (uint8_t i = 0; i < REGISTRY_MAX_CHANNELS; i++) {
+    const RegistryChannel& channel = node.channels[i];
+    if (channel.used) {
+      uint8_t fields[2] = { channel.sensorId, channel.sensorType };
+      hash += textHash(channel.unitPrefix, messageHash(fields, sizeof(fields)));
+    }
+  }
+  return hash;
+}
+
+void RegistryMerkle::rehashPath(uint8_t index) {
+  for (index /= 2; index > 0; index /= 2) {
+    uint8_t children[8];
+    putHash(children, tree_[2 * index]);
+    putHash(children + 4, tree_[2 * index + 1]);
+    tree_[index] = messageHash(children, sizeof(children));
+  }
+}
+
+void RegistryMerkle::update() {
+  uint32_t version = registry_.version();
+  if (version == version_) {
+    return;
+  }
+  for (uint8_t i = 0; i < REGISTRY_MAX_NODES; i++) {
+    if (registry_.slotVersion(i) <= version_) {
+      continue;
+    }
+    const RegistryNode& node = registry_.slot(i);
+    uint32_t hash = node.used ? nodeHash(node) : 0;
+    uint8_t leaf = node.used ? leafOf(node.address) : slotLeaf_[i];
+    if (hash == slotHash_[i] && leaf == slotLeaf_[i]) {
+      continue;
+    }
+    if (slotHash_[i]) {
+      tree_[slotLeaf_[i]] -= slotHash_[i];
+      rehashPath(slotLeaf_[i]);
+    }
+    slotHash_[i] = hash;
+    slotLeaf_[i] = leaf;
+    if (hash) {
+      tree_[leaf] += hash;
+      rehashPath(leaf);
+    }
+  }
+  version_ = version;
+}
+
+uint32_t RegistryMerkle::root() const {
+  return tree_[1];
+}
+
+uint32_t RegistryMerkle::hash(uint8_t index) const {
+  return index > 0 && index < 2 * MERKLE_LEAVES ? tree_[index] : 0;
+}
+
+void RegistryMerkle::request(uint8_t index, uint16_t address, MessageHelper& msg) {
+  msg.clearExtensions();
+  msg.setSensorAddress(address);
+  msg.setSensorID(0);
+  msg.setCommand(C_SYSTEM);
+  msg.setSystemMessageType(I_MERKLE);
+  msg.setPayloadType(P_BYNARY_BYTE);
+  memset(msg.getPayload(), 0, msg.getPayloadSize());
+  msg.getPayload()[0] = index;
+}
+
+bool RegistryMerkle::answer(const MessageHelper& request, MessageHelper& reply) const {
+  uint8_t index = request.getPayload()[0];
+  if (request.getCommand() != C_SYSTEM || request.getSystemMessageType() != I_MERKLE ||
+      index == 0 || index >= 2 * MERKLE_LEAVES) {
+    return false;
+  }
+  RegistryMerkle::request(index, request.getSensorAddress(), reply);
+  uint8_t* payload = (uint8_t*)reply.getPayload();
+  putHash(payload + 1, tree_[index]);
+  if (!isLeaf(index)) {
+    putHash(payload + 5, tree_[2 * index]);
+    putHash(payload + 9, tree_[2 * index + 1]);
+  }
+  return true;
+}
+
+uint8_t RegistryMerkle::compare(const MessageHelper& reply, uint8_t* differing) const {
+  const uint8_t* payload = (const uint8_t*)reply.getPayload();
+  uint8_t index = payload[0];
+  if (index == 0 || index >= 2 * MERKLE_LEAVES || getHash(payload + 1) == tree_[index]) {
+    return 0;
+  }
+  if (isLeaf(index)) {
+    differing[0] = index;
+    return 1;
+  }
+  uint8_t count = 0;
+  for (uint8_t child = 2 * index; child <= 2 * index + 1; child++) {
+    if (getHash(payload + 5 + 4 * (child - 2 * index)) != tree_[child]) {
+      differing[count++] = child;
+    }
+  }
+  return count;
+}
@@ -0,0 +1,87 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file RegistryMerkle.h
+ *
+ * @brief Hash tree over the NodeRegistry, to compare two registries quickly
+ *
+ * The address space 0 to MERKLE_ADDRESS_SPAN - 1 is split in MERKLE_LEAVES
+ * ranges of addresses. The hash of a leaf is the sum of the hashes of the nodes
+ * of its range (nodeHash()), the hash of an inner node the hash of its two
+ * children, so the root covers the whole registry. The tree is stored in heap
+ * order: index 1 is the root, the children of i are 2i and 2i + 1, the leaves
+ * are MERKLE_LEAVES to 2 * MERKLE_LEAVES - 1.
+ *
+ * update() follows the registry versions: a node that changed updates its leaf
+ * by difference and rehashes the path of the leaf only.
+ *
+ * To find where a standby or a controller differs, it sends a C_SYSTEM /
+ * I_MERKLE with the index of a tree node (1 first) in the first payload byte;
+ * answer() replies with the index, the hash of the node and the hashes of its
+ * children (uint32 little endian). compare() gives the children that differ,
+ * to be asked next. After log2(MERKLE_LEAVES) round trips the differing leaves
+ * are known, and only the nodes of their address ranges need a sync.
+ */
+#ifndef REGISTRYMERKLE_H
+#define REGISTRYMERKLE_H
+
+#include <Arduino.h>
+#include "Message.h"
+#include "MessageHash.h"
+#include "NodeRegistry.h"
+
+/// @brief Number of address ranges, power of 2 up to 32
+#ifndef MERKLE_LEAVES
+#define MERKLE_LEAVES 16
+#endif
+#if (MERKLE_LEAVES & (MERKLE_LEAVES - 1)) || MERKLE_LEAVES > 32
+#error "MERKLE_LEAVES must be a power of 2 up to 32"
+#endif
+/// @brief Addresses covered by the leaves, the last leaf also takes the ones above
+#ifndef MERKLE_ADDRESS_SPAN
+#define MERKLE_ADDRESS_SPAN 4096
+#endif
+
+
+class RegistryMerkle {
+
+ public:
+	RegistryMerkle(const NodeRegistry& registry);
+	/// @brief Applies the changes of the registry since the last call
+	void update();
+	uint32_t root() const;
+	/// @brief Hash of the tree node @p index (heap order)
+	uint32_t hash(uint8_t index) const;
+	static bool isLeaf(uint8_t index);
+	static uint8_t leafOf(uint16_t address);
+	/// @brief Addresses of a leaf (tree node index)
+	static void leafRange(uint8_t index, uint16_t* first, uint16_t* last);
+	/// @brief Hash of the metadata of a node, independent of the order of its children
+	static uint32_t nodeHash(const RegistryNode& node);
+
+	/// @brief Builds the reply to an I_MERKLE request
+	/// @return false if the request is not one or has a bad index
+	bool answer(const MessageHelper& request, MessageHelper& reply) const;
+	/// @brief Builds the I_MERKLE request of the tree node @p index
+	static void request(uint8_t index, uint16_t address, MessageHelper& msg);
+	/// @brief Compares an I_MERKLE reply with this tree
+	/// @param differing receives the children that differ (2 at most), or the
+	/// leaf itself if the reply is about a leaf that differs
+	/// @return the number of tree nodes written in differing
+	uint8_t compare(const MessageHelper& reply, uint8_t* differing) const;
+
+ private:
+	void rehashPath(uint8_t index);
+
+	const NodeRegistry& registry_;
+	uint32_t version_;
+	uint32_t tree_[2 * MERKLE_LEAVES];
+	uint32_t slotHash_[REGISTRY_MAX_NODES];
+	uint8_t slotLeaf_[REGISTRY_MAX_NODES];
+};
+
+#endif
@@ -0,0 +1,198 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+
+#include "RegistryReplica.h"
+#include "MessageHash.h"
+
+#define REPLICA_SLOT 'S'
+#define REPLICA_HEARTBEAT_FRAME 'H'
+#define REPLICA_HEARTBEAT_SIZE 10
+
+static_assert(REPLICA_FRAME_SIZE < 256, "RegistryNode too big for a replica frame");
+
+static void put32(uint8_t* p, uint32_t value) {
+  p[0] = (uint8_t)value;
+  p[1] = (uint8_t)(value >> 8);
+  p[2] = (uint8_t)(value >> 16);
+  p[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t get32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Check of a frame, from the kind to the end of the content
+static uint16_t frameCheck(const uint8_t* frame, uint8_t length) {
+  return (uint16_t)messageHash(frame + 1, length - 3);
+}
+
+static uint8_t frameLength(uint8_t kind) {
+  return kind == REPLICA_SLOT ? REPLICA_FRAME_SIZE : REPLICA_HEARTBEAT_SIZE;
+}
+
+//Constructor
+RegistryReplicaSender::RegistryReplicaSender(const NodeRegistry& registry, Stream& link)
+  : registry_(registry), link_(link), heartbeat_(0), cursor_(0), length_(0), sent_(0) {
+  memset(sentVersion_, 0, sizeof(sentVersion_));
+}
+
+// Builds the heartbeat when it is due, or the next changed slot
+bool RegistryReplicaSender::nextFrame() {
+  // The standby applies no slot before a heartbeat, it goes first
+  if (millis() - heartbeat_ >= REPLICA_HEARTBEAT) {
+    heartbeat_ = millis();
+    uint16_t layout = NodeRegistry::layout();
+    frame_[1] = REPLICA_HEARTBEAT_FRAME;
+    frame_[2] = (uint8_t)layout;
+    frame_[3] = (uint8_t)(layout >> 8);
+    put32(frame_ + 4, registry_.version());
+    length_ = REPLICA_HEARTBEAT_SIZE;
+  }
+  for (uint8_t n = 0; n < REGISTRY_MAX_NODES && length_ == 0; n++) {
+    uint8_t i = cursor_;
+    cursor_ = (cursor_ + 1) % REGISTRY_MAX_NODES;
+    uint32_t version = registry_.slotVersion(i);
+    if (version != sentVersion_[i]) {
+      sentVersion_[i] = version;
+      frame_[1] = REPLICA_SLOT;
+      frame_[2] = i;
+      put32(frame_ + 3, version);
+      memcpy(frame_ + 7, &registry_.slot(i), sizeof(RegistryNode));
+      length_ = REPLICA_FRAME_SIZE;
+    }
+  }
+  if (length_ == 0) {
+    return false;
+  }
+  frame_[0] = REPLICA_SYNC;
+  uint16_t check = frameCheck(frame_, length_);
+  frame_[length_ - 2] = (uint8_t)check;
+  frame_[length_ - 1] = (uint8_t)(check >> 8);
+  sent_ = 0;
+  return true;
+}
+
+void RegistryReplicaSender::pump() {
+  while (link_.available()) {
+    if (link_.read() == REPLICA_RESYNC) {
+      // The standby state is unknown, all the slots go again, free ones included
+      for (uint8_t i = 0; i < REGISTRY_MAX_NODES; i++) {
+        sentVersion_[i] = registry_.slotVersion(i) + 1;
+      }
+      heartbeat_ = millis() - REPLICA_HEARTBEAT;
+    }
+  }
+  while (sent_ < length_ || nextFrame()) {
+    int room = link_.availableForWrite();
+    if (room <= 0) {
+      return;
+    }
+    uint8_t count = length_ - sent_;
+    if (room < count) {
+      count = room;
+    }
+    sent_ += link_.write(frame_ + sent_, count);
+    if (sent_ < length_) {
+      return;
+    }
+    length_ = 0;
+    sent_ = 0;
+  }
+}
+
+//Constructor
+RegistryReplicaReceiver::RegistryReplicaReceiver(NodeRegistry& registry, Stream& link)
+  : registry_(registry), link_(link), heard_(0), resyncSent_(0), primaryVersion_(0),
+    applied_(0), started_(false), alive_(false), layoutChecked_(false), layoutMismatch_(false),
+    missed_(false), length_(0) { }
+
+// Asks for all the slots, at most once per heartbeat period
+void RegistryReplicaReceiver::resync() {
+  if (!started_ || millis() - resyncSent_ >= REPLICA_HEARTBEAT) {
+    started_ = true;
+    missed_ = false;
+    resyncSent_ = millis();
+    link_.write((uint8_t)REPLICA_RESYNC);
+  }
+}
+
+void RegistryReplicaReceiver::apply() {
+  heard_ = millis();
+  alive_ = true;
+  if (layoutMismatch_) {
+    return;
+  }
+  if (frame_[1] == REPLICA_SLOT) {
+    // The slots of a primary of unknown layout are dropped, and asked again once it is known
+    if (!layoutChecked_) {
+      missed_ = true;
+      return;
+    }
+    RegistryNode node;
+    memcpy(&node, frame_ + 7, sizeof(RegistryNode));
+    if (frame_[2] < REGISTRY_MAX_NODES) {
+      registry_.restoreSlot(frame_[2], node);
+      applied_++;
+    }
+    return;
+  }
+  uint16_t layout = frame_[2] | (frame_[3] << 8);
+  if (layout != NodeRegistry::layout()) {
+    // Asking again would get the same slots, the gateways must be rebuilt
+    layoutMismatch_ = true;
+    return;
+  }
+  layoutChecked_ = true;
+  primaryVersion_ = get32(frame_ + 4);
+}
+
+void RegistryReplicaReceiver::poll() {
+  if (!started_) {
+    resync();
+  }
+  while (link_.available()) {
+    uint8_t byte = link_.read();
+    if (length_ == 0 && byte != REPLICA_SYNC) {
+      continue;
+    }
+    if (length_ == 1 && byte != REPLICA_SLOT && byte != REPLICA_HEARTBEAT_FRAME) {
+      length_ = byte == REPLICA_SYNC ? 1 : 0;
+      continue;
+    }
+    frame_[length_++] = byte;
+    if (length_ < 2 || length_ < frameLength(frame_[1])) {
+      continue;
+    }
+    uint16_t check = frame_[length_ - 2] | (frame_[length_ - 1] << 8);
+    if (check == frameCheck(frame_, length_)) {
+      apply();
+    } else {
+      // A slot may have been lost with the frame
+      missed_ = true;
+    }
+    length_ = 0;
+  }
+  if (missed_ && layoutChecked_ && !layoutMismatch_) {
+    resync();
+  }
+}
+
+bool RegistryReplicaReceiver::primaryAlive() const {
+  return alive_ && millis() - heard_ < REPLICA_TIMEOUT;
+}
+
+uint32_t RegistryReplicaReceiver::primaryVersion() const {
+  return primaryVersion_;
+}
+
+uint32_t RegistryReplicaReceiver::applied() const {
+  return applied_;
+}
+
+bool RegistryReplicaReceiver::layoutMismatch() const {
+  return layoutMismatch_;
+}
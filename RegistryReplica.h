@@ -0,0 +1,108 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file RegistryReplica.h
+ *
+ * @brief Replication of the NodeRegistry to a hot standby gateway
+ *
+ * The primary and the standby are linked by a Stream (a serial port between
+ * the two boards). The primary sends every slot of its registry that changed
+ * since it was last sent, newest state only, and a heartbeat every
+ * REPLICA_HEARTBEAT ms; the standby applies the slots to its own registry as
+ * they come, so it holds the state of the primary when it takes over. The
+ * slots applied are marked dirty, so a RegistrySnapshot of the standby saves
+ * them. Frames:
+ *
+ *     REPLICA_SYNC, 'S', slot, version (4), RegistryNode, check (2)
+ *     REPLICA_SYNC, 'H', layout (2), version (4), check (2)
+ *
+ * A standby that starts or reads a broken frame sends REPLICA_RESYNC, and the
+ * primary sends its heartbeat then all its slots again. The standby applies no
+ * slot before a heartbeat told it the primary has the same registry layout
+ * (NodeRegistry::layout(), both gateways must be built with the same one), the
+ * slots dropped until then are asked again. A heartbeat of another layout
+ * stops the replication for good, layoutMismatch() reports it. The cached
+ * values are not replicated, the nodes report them again. The link of the
+ * primary must implement availableForWrite() (HardwareSerial does), so pump()
+ * never blocks.
+ */
+#ifndef REGISTRYREPLICA_H
+#define REGISTRYREPLICA_H
+
+#include <Arduino.h>
+#include "NodeRegistry.h"
+
+/// @brief Time in ms between two heartbeats of the primary
+#ifndef REPLICA_HEARTBEAT
+#define REPLICA_HEARTBEAT 500
+#endif
+/// @brief Time in ms without frame after which the primary is considered down
+#ifndef REPLICA_TIMEOUT
+#define REPLICA_TIMEOUT 2000
+#endif
+
+#define REPLICA_SYNC 0xA5
+#define REPLICA_RESYNC 'R'
+#define REPLICA_FRAME_SIZE (7 + sizeof(RegistryNode) + 2)
+
+
+class RegistryReplicaSender {
+
+ public:
+	RegistryReplicaSender(const NodeRegistry& registry, Stream& link);
+	/// @brief Sends what the link takes without blocking, to be called from loop()
+	void pump();
+
+ private:
+	bool nextFrame();
+
+	const NodeRegistry& registry_;
+	Stream& link_;
+	uint32_t sentVersion_[REGISTRY_MAX_NODES];
+	uint32_t heartbeat_;
+	uint8_t cursor_;
+	uint8_t length_;
+	uint8_t sent_;
+	uint8_t frame_[REPLICA_FRAME_SIZE];
+};
+
+
+class RegistryReplicaReceiver {
+
+ public:
+	RegistryReplicaReceiver(NodeRegistry& registry, Stream& link);
+	/// @brief Applies the frames received, to be called from loop()
+	void poll();
+	/// @brief false when the primary has not been heard for REPLICA_TIMEOUT ms
+	bool primaryAlive() const;
+	/// @brief Version of the primary registry at its last heartbeat
+	uint32_t primaryVersion() const;
+	/// @brief Number of slots applied
+	uint32_t applied() const;
+	/// @brief true when the primary has another registry layout, nothing is applied then
+	bool layoutMismatch() const;
+
+ private:
+	void apply();
+	void resync();
+
+	NodeRegistry& registry_;
+	Stream& link_;
+	uint32_t heard_;
+	uint32_t resyncSent_;
+	uint32_t primaryVersion_;
+	uint32_t applied_;
+	bool started_;
+	bool alive_;
+	bool layoutChecked_;
+	bool layoutMismatch_;
+	bool missed_;
+	uint8_t length_;
+	uint8_t frame_[REPLICA_FRAME_SIZE];
+};
+
+#endif
@@ -0,0 +1,132 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+
+#include "RegistrySnapshot.h"
+#include "MessageHash.h"
+
+#define SNAPSHOT_MAGIC 0x5352 // "RS"
+
+//Constructor
+RegistrySnapshot::RegistrySnapshot(NodeRegistry& registry, uint16_t base)
+  : registry_(registry), base_(base) {
+  memset(seq_, 0, sizeof(seq_));
+  memset(nextCopy_, 0, sizeof(nextCopy_));
+  cursor_ = 0;
+  formatted_ = false;
+}
+
+bool RegistrySnapshot::fits() const {
+  return (uint32_t)base_ + REGISTRY_SNAPSHOT_SIZE <= EEPROM.length();
+}
+
+uint16_t RegistrySnapshot::recordAddress(uint8_t index, uint8_t copy) const {
+  return base_ + 4 + (index * 2 + copy) * REGISTRY_SNAPSHOT_RECORD_SIZE;
+}
+
+bool RegistrySnapshot::readRecord(uint8_t index, uint8_t copy, RegistryNode* node, uint8_t* seq) const {
+  uint16_t address = recordAddress(index, copy);
+  uint8_t* bytes = (uint8_t*)node;
+  *seq = EEPROM.read(address);
+  for (uint16_t i = 0; i < sizeof(RegistryNode); i++) {
+    bytes[i] = EEPROM.read(address + 1 + i);
+  }
+  uint16_t stored = EEPROM.read(address + 1 + sizeof(RegistryNode)) |
+                    (EEPROM.read(address + 2 + sizeof(RegistryNode)) << 8);
+  uint32_t hash = messageHash(seq, 1);
+  return stored == (uint16_t)messageHash(node, sizeof(RegistryNode), hash);
+}
+
+void RegistrySnapshot::writeRecord(uint8_t index, uint8_t copy, const RegistryNode& node, uint8_t seq) {
+  uint16_t address = recordAddress(index, copy);
+  const uint8_t* bytes = (const uint8_t*)&node;
+  uint16_t check = (uint16_t)messageHash(&node, sizeof(RegistryNode), messageHash(&seq, 1));
+  // A copy torn by a reset fails its checksum, the other copy is then used
+  EEPROM.update(address, seq);
+  for (uint16_t i = 0; i < sizeof(RegistryNode); i++) {
+    EEPROM.update(address + 1 + i, bytes[i]);
+  }
+  EEPROM.update(address + 1 + sizeof(RegistryNode), (uint8_t)check);
+  EEPROM.update(address + 2 + sizeof(RegistryNode), (uint8_t)(check >> 8));
+}
+
+uint8_t RegistrySnapshot::restore() {
+  if (!fits()) {
+    return 0;
+  }
+  uint16_t magic = EEPROM.read(base_) | (EEPROM.read(base_ + 1) << 8);
+  uint16_t layout = EEPROM.read(base_ + 2) | (EEPROM.read(base_ + 3) << 8);
+  // A snapshot written with another registry layout cannot be restored slot by slot
+  formatted_ = magic == SNAPSHOT_MAGIC && layout == NodeRegistry::layout();
+  if (!formatted_) {
+    return 0;
+  }
+
+  uint8_t restored = 0;
+  RegistryNode node;
+  for (uint8_t i = 0; i < REGISTRY_MAX_NODES; i++) {
+    uint8_t seqA, seqB;
+    bool validA = readRecord(i, 0, &node, &seqA);
+    bool validB = readRecord(i, 1, &node, &seqB);
+    // Newest valid copy wins, the next save goes over the other one
+    uint8_t best = validB && (!validA || (int8_t)(seqB - seqA) > 0) ? 1 : 0;
+    if (!(best ? validB : validA)) {
+      continue;
+    }
+    readRecord(i, best, &node, &seq_[i]);
+    if (best) {
+      nextCopy_[i >> 3] &= ~(1 << (i & 7));
+    } else {
+      nextCopy_[i >> 3] |= 1 << (i & 7);
+    }
+    registry_.restoreSlot(i, node);
+    registry_.takeDirty(i);
+    if (node.used) {
+      restored++;
+    }
+  }
+  return restored;
+}
+
+uint8_t RegistrySnapshot::save(uint8_t maxSlots) {
+  // The records would wrap around and overwrite the start of the EEPROM
+  if (!fits()) {
+    return 0;
+  }
+  if (!formatted_) {
+    // New area: write every slot once, then the header
+    for (uint8_t i = 0; i < REGISTRY_MAX_NODES; i++) {
+      registry_.takeDirty(i);
+      writeRecord(i, 0, registry_.slot(i), 1);
+      seq_[i] = 1;
+      nextCopy_[i >> 3] |= 1 << (i & 7);
+      EEPROM.update(recordAddress(i, 1), 0);
+    }
+    uint16_t layout = NodeRegistry::layout();
+    EEPROM.update(base_ + 2, (uint8_t)layout);
+    EEPROM.update(base_ + 3, (uint8_t)(layout >> 8));
+    EEPROM.update(base_, (uint8_t)SNAPSHOT_MAGIC);
+    EEPROM.update(base_ + 1, (uint8_t)(SNAPSHOT_MAGIC >> 8));
+    formatted_ = true;
+    return REGISTRY_MAX_NODES;
+  }
+
+  uint8_t written = 0;
+  for (uint8_t n = 0; n < REGISTRY_MAX_NODES && written < maxSlots; n++) {
+    uint8_t i = cursor_;
+    cursor_ = (cursor_ + 1) % REGISTRY_MAX_NODES;
+    if (!registry_.takeDirty(i)) {
+      continue;
+    }
+    uint8_t mask = 1 << (i & 7);
+    uint8_t copy = (nextCopy_[i >> 3] & mask) ? 1 : 0;
+    seq_[i]++;
+    writeRecord(i, copy, registry_.slot(i), seq_[i]);
+    nextCopy_[i >> 3] ^= mask;
+    written++;
+  }
+  return written;
+}
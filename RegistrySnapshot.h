@@ -0,0 +1,60 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file RegistrySnapshot.h
+ *
+ * @brief Incremental, crash consistent snapshot of the NodeRegistry in EEPROM
+ *
+ * Every registry slot has two copies in EEPROM, each with a sequence number and
+ * a checksum. save() rewrites only the slots changed since the previous save,
+ * always over the older copy, so a reset during a write leaves the newer copy
+ * intact. Only the bytes that differ are written (EEPROM.update()). restore()
+ * reads the newest valid copy of every slot at boot, so the gateway knows its
+ * nodes again without waiting for them to present themselves.
+ */
+#ifndef REGISTRYSNAPSHOT_H
+#define REGISTRYSNAPSHOT_H
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "NodeRegistry.h"
+
+/// @brief Bytes of a copy: sequence number, slot, 16 bit checksum
+#define REGISTRY_SNAPSHOT_RECORD_SIZE (sizeof(RegistryNode) + 3)
+/// @brief Bytes of EEPROM used from the base address, about 3.5 KB for 16 nodes and
+/// under 1 KB for the 4 nodes of the default registry on an ATmega328
+#define REGISTRY_SNAPSHOT_SIZE (4 + 2 * REGISTRY_MAX_NODES * REGISTRY_SNAPSHOT_RECORD_SIZE)
+
+
+class RegistrySnapshot {
+
+ public:
+	/// @param base EEPROM address of the snapshot area
+	RegistrySnapshot(NodeRegistry& registry, uint16_t base = 0);
+	/// @brief False if the area goes past the end of the EEPROM, nothing is read nor written then
+	bool fits() const;
+	/// @brief Loads the registry from EEPROM, call it once at boot
+	/// @return number of nodes restored
+	uint8_t restore();
+	/// @brief Writes up to @p maxSlots changed slots, call it periodically
+	/// @return number of slots written
+	uint8_t save(uint8_t maxSlots = REGISTRY_MAX_NODES);
+
+ private:
+	uint16_t recordAddress(uint8_t index, uint8_t copy) const;
+	bool readRecord(uint8_t index, uint8_t copy, RegistryNode* node, uint8_t* seq) const;
+	void writeRecord(uint8_t index, uint8_t copy, const RegistryNode& node, uint8_t seq);
+
+	NodeRegistry& registry_;
+	uint16_t base_;
+	uint8_t seq_[REGISTRY_MAX_NODES];
+	uint8_t nextCopy_[(REGISTRY_MAX_NODES + 7) / 8];
+	uint8_t cursor_;
+	bool formatted_;
+};
+
+#endif
@@ -0,0 +1,172 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+
+#include "RegistrySync.h"
+#include "PayloadParser.h"
+
+//Constructor
+RegistrySync::RegistrySync(const NodeRegistry& registry, uint16_t epoch)
+  : registry_(registry), epoch_(epoch), since_(0), target_(0), full_(false),
+    phase_(SYNC_DONE), slot_(0), item_(0) { }
+
+bool RegistrySync::begin(const MessageHelper& request) {
+  if (request.getCommand() != C_SYSTEM || request.getSystemMessageType() != I_SYNC) {
+    return false;
+  }
+  const char* payload = request.getPayload();
+  uint8_t size = request.getPayloadSize();
+  uint32_t epoch = 0;
+  uint32_t since = 0;
+  uint8_t used;
+  if (parseUInt32(payload, size, &epoch, &used) != PARSE_OK || used >= size || payload[used] != ';' ||
+      parseUInt32(payload + used + 1, size - used - 1, &since) != PARSE_OK || epoch > 0xFFFF) {
+    // Not an epoch this gateway can have sent, a full sync is forced
+    epoch = 0;
+    since = 0;
+  }
+  begin(epoch, since);
+  return true;
+}
+
+void RegistrySync::begin(uint16_t epoch, uint32_t since) {
+  target_ = registry_.version();
+  full_ = epoch != epoch_ || since > target_ || since < registry_.horizon() || since == 0;
+  since_ = full_ ? 0 : since;
+  phase_ = SYNC_HEADER;
+  slot_ = 0;
+  item_ = 0;
+}
+
+bool RegistrySync::full() const {
+  return full_;
+}
+
+// I_SYNC message, with the epoch and the version for the header and the end
+void RegistrySync::syncMessage(MessageHelper& msg, uint16_t address, char tag) const {
+  msg.clearExtensions();
+  msg.setSensorAddress(address);
+  msg.setSensorID(0);
+  msg.setCommand(C_SYSTEM);
+  msg.setSystemMessageType(I_SYNC);
+  msg.setPayloadType(P_STRING);
+  if (tag == 'R') {
+    strcpy_P(msg.getPayload(), PSTR("R"));
+  } else {
+    snprintf_P(msg.getPayload(), msg.getPayloadSize(), PSTR("%c;%u;%lu"),
+               tag, (unsigned)epoch_, (unsigned long)target_);
+  }
+}
+
+// Builds the next message of the node in slot_, false when the node has nothing more to send
+bool RegistrySync::nodeMessage(MessageHelper& msg) {
+  const RegistryNode& node = registry_.slot(slot_);
+  if (registry_.slotVersion(slot_) <= since_) {
+    return false;
+  }
+  if (!node.used) {
+    // A removed node that came back in another slot is not removed
+    if (item_++ || full_ || registry_.find(node.address)) {
+      return false;
+    }
+    syncMessage(msg, node.address, 'R');
+    return true;
+  }
+
+  msg.clearExtensions();
+  msg.setSensorAddress(node.address);
+  msg.setSensorID(0);
+  memset(msg.getPayload(), 0, msg.getPayloadSize());
+  while (true) {
+    uint8_t item = item_++;
+    if (item == 0 || item == 1) {
+      msg.setCommand(C_SYSTEM);
+      msg.setSystemMessageType(item == 0 ? I_SKETCH_NAME : I_SKETCH_VERSION);
+      msg.setPayloadType(P_STRING);
+      strcpy(msg.getPayload(), item == 0 ? node.sketchName : node.sketchVersion);
+      return true;
+    }
+    uint8_t c = (item - 2) / 2;
+    if (c >= REGISTRY_MAX_CHANNELS) {
+      return false;
+    }
+    const RegistryChannel& channel = node.channels[c];
+    if (!channel.used) {
+      continue;
+    }
+    msg.setSensorID(channel.sensorId);
+    if ((item - 2) % 2 == 0) {
+      msg.setCommand(C_PRESENTATION_CHILDREN);
+      msg.setSensorType(channel.sensorType);
+      msg.setPayloadType(P_HEARTBEAT);
+      return true;
+    }
+    if (channel.unitPrefix[0]) {
+      msg.setCommand(C_SET);
+      msg.setSensorInformationType(V_UNIT_PREFIX);
+      msg.setPayloadType(P_STRING);
+      strcpy(msg.getPayload(), channel.unitPrefix);
+      return true;
+    }
+  }
+}
+
+bool RegistrySync::next(MessageHelper& msg) {
+  while (true) {
+    switch (phase_) {
+      case SYNC_HEADER:
+        phase_ = SYNC_NODES;
+        syncMessage(msg, 0, full_ ? 'F' : 'D');
+        return true;
+
+      case SYNC_NODES:
+        if (slot_ == REGISTRY_MAX_NODES) {
+          phase_ = SYNC_VALUES;
+          slot_ = 0;
+        } else if (nodeMessage(msg)) {
+          return true;
+        } else {
+          slot_++;
+          item_ = 0;
+        }
+        break;
+
+      case SYNC_VALUES:
+        if (slot_ == REGISTRY_MAX_VALUES) {
+          phase_ = SYNC_END;
+        } else {
+          const RegistryValue& value = registry_.valueSlot(slot_++);
+          if (!value.used && value.version > since_ && !full_ &&
+              registry_.findValue(value.address, value.sensorId, value.type) == NULL) {
+            syncMessage(msg, value.address, 'V');
+            msg.setSensorID(value.sensorId);
+            snprintf_P(msg.getPayload(), msg.getPayloadSize(), PSTR("V;%u"), (unsigned)value.type);
+            return true;
+          }
+          if (value.used && value.version > since_) {
+            msg.clearExtensions();
+            msg.setSensorAddress(value.address);
+            msg.setSensorID(value.sensorId);
+            msg.setCommand(C_SET);
+            msg.setSensorInformationType(value.type);
+            msg.setPayloadType(value.datatype);
+            memset(msg.getPayload(), 0, msg.getPayloadSize());
+            memcpy(msg.getPayload(), value.value, value.length);
+            return true;
+          }
+        }
+        break;
+
+      case SYNC_END:
+        phase_ = SYNC_DONE;
+        syncMessage(msg, 0, 'E');
+        return true;
+
+      default:
+        return false;
+    }
+  }
+}
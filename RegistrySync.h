@@ -0,0 +1,74 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file RegistrySync.h
+ *
+ * @brief Incremental sync of the NodeRegistry state to a controller
+ *
+ * A controller that connects sends a C_SYSTEM / I_SYNC with the payload
+ * "<epoch>;<version>": the epoch and version of the last sync it completed, or
+ * "0;0". The gateway answers with a stream of messages built by next():
+ *
+ *     I_SYNC "D;<epoch>;<version>"    only the changes follow
+ *     I_SYNC "F;<epoch>;<version>"    the whole state follows, drop what you had
+ *     for each node changed: I_SKETCH_NAME, I_SKETCH_VERSION, then for each
+ *       child C_PRESENTATION_CHILDREN and its V_UNIT_PREFIX (C_SET) if any
+ *     I_SYNC "R" from a node removed
+ *     C_SET of each cached value changed
+ *     I_SYNC "V;<type>" from a child whose cached value of that type is dropped
+ *     I_SYNC "E;<epoch>;<version>"    the controller is at this version
+ *
+ * The whole state is sent when the version of the controller comes from
+ * another epoch (the gateway gives a new epoch at every boot, a boot counter
+ * for instance), is newer than the registry or older than its horizon().
+ * The messages are built one by one, so the sync interleaves with the traffic.
+ */
+#ifndef REGISTRYSYNC_H
+#define REGISTRYSYNC_H
+
+#include <Arduino.h>
+#include "Message.h"
+#include "NodeRegistry.h"
+
+class RegistrySync {
+
+ public:
+	/// @param epoch changes at every boot of the gateway
+	RegistrySync(const NodeRegistry& registry, uint16_t epoch);
+	/// @brief Starts a sync from the I_SYNC request of a controller
+	/// @return false if msg is not a sync request
+	bool begin(const MessageHelper& request);
+	/// @brief Starts a sync from @p since, of the epoch @p epoch
+	void begin(uint16_t epoch, uint32_t since);
+	/// @brief Builds the next message of the sync, false when it is over
+	bool next(MessageHelper& msg);
+	/// @brief Whether the sync in progress sends the whole state
+	bool full() const;
+
+ private:
+	typedef enum : unsigned char {
+		SYNC_HEADER,
+		SYNC_NODES,
+		SYNC_VALUES,
+		SYNC_END,
+		SYNC_DONE
+	} Sync_phase;
+
+	bool nodeMessage(MessageHelper& msg);
+	void syncMessage(MessageHelper& msg, uint16_t address, char tag) const;
+
+	const NodeRegistry& registry_;
+	uint16_t epoch_;
+	uint32_t since_;
+	uint32_t target_;
+	bool full_;
+	Sync_phase phase_;
+	uint8_t slot_;
+	uint8_t item_;
+};
+
+#endif
@@ -0,0 +1,318 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+
+#include "RepeaterAggregator.h"
+#include "PayloadParser.h"
+
+// Size of the value of a reading, numeric payloads have a fixed size
+static uint8_t valueSize(Payload_type type, const char* payload, uint8_t size) {
+  switch (type) {
+    case P_INT:
+    case P_UINT:
+      return 2;
+    case P_LONG32:
+    case P_ULONG32:
+    case P_FLOAT32:
+      return 4;
+    case P_BOOL:
+    case P_CHAR:
+    case P_UCHAR:
+    case P_BYNARY_BYTE:
+      return 1;
+    case P_STRING: {
+      uint8_t length = 0;
+      while (length < size && payload[length]) length++;
+      return length;
+    }
+    default:
+      return 0;
+  }
+}
+
+// Datatype byte of a received record, which must not set MESSAGE_EXTENDED or any unknown type
+static bool knownType(uint8_t type) {
+  switch (type) {
+    case P_STRING:
+    case P_INT:
+    case P_UINT:
+    case P_LONG32:
+    case P_ULONG32:
+    case P_FLOAT32:
+    case P_HEARTBEAT:
+    case P_ACK:
+    case P_BOOL:
+    case P_CHAR:
+    case P_UCHAR:
+    case P_BYNARY_BYTE:
+    case P_SUMMARY:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Numeric value of a reading, for the group summaries
+static bool valueOf(Payload_type type, const char* payload, uint8_t size, float* value) {
+  const uint8_t* p = (const uint8_t*)payload;
+  switch (type) {
+    case P_INT:
+      *value = (int16_t)(p[0] | (p[1] << 8));
+      return true;
+    case P_UINT:
+      *value = (uint16_t)(p[0] | (p[1] << 8));
+      return true;
+    case P_LONG32:
+    case P_ULONG32: {
+      uint32_t v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+      *value = type == P_LONG32 ? (float)(int32_t)v : (float)v;
+      return true;
+    }
+    case P_FLOAT32:
+      memcpy(value, p, sizeof(float));
+      return true;
+    case P_CHAR:
+      *value = (int8_t)p[0];
+      return true;
+    case P_BOOL:
+    case P_UCHAR:
+    case P_BYNARY_BYTE:
+      *value = p[0];
+      return true;
+    case P_STRING:
+      return parseFloat(payload, size, value) == PARSE_OK;
+    default:
+      return false;
+  }
+}
+
+//Constructor
+RepeaterAggregator::RepeaterAggregator(uint16_t address, uint16_t window)
+  : address_(address), window_(window), since_(0), held_(false), length_(0),
+    groupCount_(0), collected_(0), frames_(0) { }
+
+int8_t RepeaterAggregator::addGroup(uint8_t groupId, Sensor_information_type type) {
+  if (groupCount_ == AGGREGATOR_GROUPS) {
+    return -1;
+  }
+  Group& group = groups_[groupCount_];
+  memset(&group, 0, sizeof(Group));
+  group.id = groupId;
+  group.type = type;
+  return groupCount_++;
+}
+
+bool RepeaterAggregator::addMember(int8_t group, uint16_t address, uint8_t sensorId) {
+  if (group < 0 || group >= groupCount_ || groups_[group].memberCount == AGGREGATOR_GROUP_MEMBERS) {
+    return false;
+  }
+  Member& member = groups_[group].members[groups_[group].memberCount++];
+  member.address = address;
+  member.sensorId = sensorId;
+  return true;
+}
+
+int8_t RepeaterAggregator::groupOf(const MessageHelper& msg) const {
+  for (uint8_t g = 0; g < groupCount_; g++) {
+    if (groups_[g].type != msg.getSensorInformationType()) {
+      continue;
+    }
+    for (uint8_t m = 0; m < groups_[g].memberCount; m++) {
+      if (groups_[g].members[m].address == msg.getSensorAddress() &&
+          groups_[g].members[m].sensorId == msg.getSensorID()) {
+        return g;
+      }
+    }
+  }
+  return -1;
+}
+
+// Room kept in the frame for the summaries of the groups that have readings
+uint8_t RepeaterAggregator::reserved() const {
+  uint8_t size = 0;
+  for (uint8_t g = 0; g < groupCount_; g++) {
+    if (groups_[g].count) {
+      size += AGGREGATOR_RECORD_HEADER + AGGREGATOR_SUMMARY_SIZE;
+    }
+  }
+  return size;
+}
+
+bool RepeaterAggregator::isEvent(Sensor_information_type type) {
+  switch (type) {
+    case V_STATUS:
+    case V_ARMED:
+    case V_TRIPPED:
+    case V_LOCK_STATUS:
+    case V_MOTION:
+    case V_SCENE_ON:
+    case V_SCENE_OFF:
+    case V_UP:
+    case V_DOWN:
+    case V_STOP:
+      return true;
+    default:
+      return false;
+  }
+}
+
+Aggregate_result RepeaterAggregator::collect(const MessageHelper& msg) {
+  Payload_type type = msg.getPayloadType();
+  if (msg.getCommand() != C_SET || msg.hasExtensions() || type == P_BOOL ||
+      isEvent(msg.getSensorInformationType())) {
+    return AGG_FORWARD;
+  }
+  const char* payload = msg.getPayload();
+  uint8_t size = valueSize(type, payload, msg.getPayloadSize());
+  uint8_t room = MESSAGE_PAYLOAD_SIZE - 1 - length_ - reserved();
+
+  int8_t g = groupOf(msg);
+  float value;
+  if (g >= 0 && valueOf(type, payload, msg.getPayloadSize(), &value)) {
+    Group& group = groups_[g];
+    if (group.count == 0) {
+      if (room < AGGREGATOR_RECORD_HEADER + AGGREGATOR_SUMMARY_SIZE) {
+        return AGG_FLUSH_FIRST;
+      }
+      group.min = value;
+      group.max = value;
+      group.sum = 0;
+    }
+    if (value < group.min) group.min = value;
+    if (value > group.max) group.max = value;
+    group.sum += value;
+    if (group.count < 255) group.count++;
+  } else {
+    if (size + AGGREGATOR_RECORD_HEADER > MESSAGE_PAYLOAD_SIZE - 1) {
+      return AGG_FORWARD;
+    }
+    // A reading equal to the one held is dropped, a new value waits for the next frame
+    uint8_t* record = NULL;
+    for (uint8_t pos = 0; pos < length_; pos += AGGREGATOR_RECORD_HEADER + buffer_[pos + 5]) {
+      uint8_t* r = buffer_ + pos;
+      if ((r[0] | (r[1] << 8)) == msg.getSensorAddress() && r[2] == msg.getSensorID() &&
+          r[3] == msg.getSensorInformationType() && r[4] == type && r[5] == size) {
+        record = r;
+        break;
+      }
+    }
+    if (record != NULL && memcmp(record + AGGREGATOR_RECORD_HEADER, payload, size) != 0) {
+      return AGG_FLUSH_FIRST;
+    }
+    if (record == NULL) {
+      if (room < AGGREGATOR_RECORD_HEADER + size) {
+        return AGG_FLUSH_FIRST;
+      }
+      record = buffer_ + length_;
+      length_ += AGGREGATOR_RECORD_HEADER + size;
+      record[0] = (uint8_t)msg.getSensorAddress();
+      record[1] = (uint8_t)(msg.getSensorAddress() >> 8);
+      record[2] = msg.getSensorID();
+      record[3] = msg.getSensorInformationType();
+      record[4] = type;
+      record[5] = size;
+      memcpy(record + AGGREGATOR_RECORD_HEADER, payload, size);
+    }
+  }
+
+  // The window starts with the first reading held
+  if (!held_) {
+    held_ = true;
+    since_ = millis();
+  }
+  collected_++;
+  return AGG_HELD;
+}
+
+bool RepeaterAggregator::poll(MessageHelper& frame) {
+  if (!held_ || millis() - since_ < window_) {
+    return false;
+  }
+  return flush(frame);
+}
+
+bool RepeaterAggregator::flush(MessageHelper& frame) {
+  if (!held_) {
+    return false;
+  }
+  frame.clearExtensions();
+  frame.setSensorAddress(address_);
+  frame.setSensorID(0);
+  frame.setCommand(C_SYSTEM);
+  frame.setSystemMessageType(I_AGGREGATE);
+  frame.setPayloadType(P_BYNARY_BYTE);
+  uint8_t* payload = (uint8_t*)frame.getPayload();
+  memcpy(payload + 1, buffer_, length_);
+  uint8_t length = length_;
+
+  for (uint8_t g = 0; g < groupCount_; g++) {
+    Group& group = groups_[g];
+    if (group.count == 0) {
+      continue;
+    }
+    uint8_t* r = payload + 1 + length;
+    float avg = group.sum / group.count;
+    r[0] = (uint8_t)address_;
+    r[1] = (uint8_t)(address_ >> 8);
+    r[2] = group.id;
+    r[3] = group.type;
+    r[4] = P_SUMMARY;
+    r[5] = AGGREGATOR_SUMMARY_SIZE;
+    memcpy(r + AGGREGATOR_RECORD_HEADER, &group.min, sizeof(float));
+    memcpy(r + AGGREGATOR_RECORD_HEADER + 4, &group.max, sizeof(float));
+    memcpy(r + AGGREGATOR_RECORD_HEADER + 8, &avg, sizeof(float));
+    r[AGGREGATOR_RECORD_HEADER + 12] = group.count;
+    length += AGGREGATOR_RECORD_HEADER + AGGREGATOR_SUMMARY_SIZE;
+    group.count = 0;
+  }
+  payload[0] = length;
+  memset(payload + 1 + length, 0, MESSAGE_PAYLOAD_SIZE - 1 - length);
+
+  length_ = 0;
+  held_ = false;
+  frames_++;
+  return true;
+}
+
+uint32_t RepeaterAggregator::collected() const {
+  return collected_;
+}
+
+uint32_t RepeaterAggregator::frames() const {
+  return frames_;
+}
+
+uint8_t aggregateNext(const MessageHelper& frame, uint8_t offset, MessageHelper& reading) {
+  const uint8_t* payload = (const uint8_t*)frame.getPayload();
+  uint8_t end = 1 + payload[0];
+  uint8_t pos = offset ? offset : 1;
+  if (frame.getCommand() != C_SYSTEM || frame.getSystemMessageType() != I_AGGREGATE ||
+      end > frame.getPayloadSize() || pos + AGGREGATOR_RECORD_HEADER > end) {
+    return 0;
+  }
+  // A record with a bad datatype is skipped, the next ones are still read
+  while (pos + AGGREGATOR_RECORD_HEADER <= end) {
+    const uint8_t* r = payload + pos;
+    uint8_t size = r[5];
+    if (pos + AGGREGATOR_RECORD_HEADER + size > end) {
+      return 0;
+    }
+    pos += AGGREGATOR_RECORD_HEADER + size;
+    if (!knownType(r[4])) {
+      continue;
+    }
+    reading.clearExtensions();
+    reading.setSensorAddress(r[0] | (r[1] << 8));
+    reading.setSensorID(r[2]);
+    reading.setCommand(C_SET);
+    reading.setSensorInformationType((Sensor_information_type)r[3]);
+    reading.setPayloadType((Payload_type)r[4]);
+    memset(reading.getPayload(), 0, reading.getPayloadSize());
+    memcpy(reading.getPayload(), r + AGGREGATOR_RECORD_HEADER, size);
+    return pos;
+  }
+  return 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file RepeaterAggregator.h
+ *
+ * @brief Aggregation of the children readings at an S_ARDUINO_REPEATER_NODE
+ *
+ * Instead of forwarding every C_SET of its children upstream, the repeater
+ * holds them for a window and sends them as one C_SYSTEM / I_AGGREGATE frame:
+ *
+ *     length of the records, then the records: address (2), sensor id,
+ *     information type, datatype, value length, value
+ *
+ * The events (isEvent(), alarms and on/off states) and the P_BOOL readings are
+ * never held, they are forwarded at once. A reading equal to the one held for
+ * its channel is dropped, a different one is only held after the frame that
+ * carries the older one went upstream, so no change is lost. The readings
+ * of the channels of a group are not forwarded, the frame carries one P_SUMMARY
+ * record per group instead (address of the repeater, sensor id of the group).
+ *
+ *     RepeaterAggregator aggregator(myAddress, 2000);
+ *     ...
+ *     switch (aggregator.collect(msg)) {
+ *       case AGG_FLUSH_FIRST: if (aggregator.flush(frame)) send(frame); aggregator.collect(msg); break;
+ *       case AGG_FORWARD: send(msg); break;
+ *       default: break;
+ *     }
+ *     if (aggregator.poll(frame)) send(frame);
+ *
+ * The gateway reads the records back with aggregateNext().
+ */
+#ifndef REPEATERAGGREGATOR_H
+#define REPEATERAGGREGATOR_H
+
+#include <Arduino.h>
+#include "Message.h"
+
+/// @brief Default time in ms the readings are held
+#ifndef AGGREGATOR_WINDOW
+#define AGGREGATOR_WINDOW 1000
+#endif
+#ifndef AGGREGATOR_GROUPS
+#define AGGREGATOR_GROUPS 4
+#endif
+#ifndef AGGREGATOR_GROUP_MEMBERS
+#define AGGREGATOR_GROUP_MEMBERS 8
+#endif
+/// @brief Size of a record without its value
+#define AGGREGATOR_RECORD_HEADER 6
+/// @brief Size of the value of a P_SUMMARY record
+#define AGGREGATOR_SUMMARY_SIZE 13
+
+/// @brief Result of RepeaterAggregator::collect()
+typedef enum : unsigned char {
+	AGG_HELD				= 0,	//!< The reading will go upstream with the next frame
+	AGG_FORWARD				= 1,	//!< The message is not aggregated, forward it as is
+	AGG_FLUSH_FIRST			= 2		//!< The frame is full or holds an older value, flush() it and collect the message again
+} Aggregate_result;
+
+
+class RepeaterAggregator {
+
+ public:
+	/// @param address network address of the repeater
+	/// @param window time in ms a reading may be held
+	RepeaterAggregator(uint16_t address, uint16_t window = AGGREGATOR_WINDOW);
+	/// @brief Declares a group summarized as the child @p groupId of the repeater
+	/// @return the group index, -1 if there is no room left
+	int8_t addGroup(uint8_t groupId, Sensor_information_type type);
+	/// @brief Adds a channel to a group, its readings of the group type are summarized
+	bool addMember(int8_t group, uint16_t address, uint8_t sensorId);
+
+	Aggregate_result collect(const MessageHelper& msg);
+	/// @brief True for the alarms, states and commands that are forwarded as they come
+	static bool isEvent(Sensor_information_type type);
+	/// @brief Builds the frame when the oldest held reading reaches the window
+	bool poll(MessageHelper& frame);
+	/// @brief Builds the frame now, false if nothing is held
+	bool flush(MessageHelper& frame);
+
+	/// @brief Number of messages held, and of frames sent in their place
+	uint32_t collected() const;
+	uint32_t frames() const;
+
+ private:
+	typedef struct {
+		uint16_t address;
+		uint8_t sensorId;
+	} Member;
+
+	typedef struct {
+		uint8_t id;
+		Sensor_information_type type;
+		uint8_t memberCount;
+		uint8_t count;
+		float min;
+		float max;
+		float sum;
+		Member members[AGGREGATOR_GROUP_MEMBERS];
+	} Group;
+
+	int8_t groupOf(const MessageHelper& msg) const;
+	uint8_t reserved() const;
+
+	uint16_t address_;
+	uint16_t window_;
+	uint32_t since_;
+	bool held_;
+	uint8_t length_;
+	uint8_t groupCount_;
+	uint32_t collected_;
+	uint32_t frames_;
+	Group groups_[AGGREGATOR_GROUPS];
+	uint8_t buffer_[MESSAGE_PAYLOAD_SIZE];
+};
+
+/// @brief Reads the record at @p offset of an I_AGGREGATE frame as a C_SET message
+/// @param offset 0 for the first record, then the value returned by the previous call
+/// @return the offset of the next record, 0 when there is no record left
+uint8_t aggregateNext(const MessageHelper& frame, uint8_t offset, MessageHelper& reading);
+
+#endif
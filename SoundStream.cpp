@@ -0,0 +1,299 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+
+#include "SoundStream.h"
+
+static const int8_t adpcmIndexTable[16] PROGMEM = {
+  -1, -1, -1, -1, 2, 4, 6, 8,
+  -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+static const uint16_t adpcmStepTable[89] PROGMEM = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+  253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+  1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+  3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+  11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+  32767
+};
+
+// Applies one 4 bit code to the state, returns the reconstructed sample
+static int16_t adpcmStep(AdpcmState& state, uint8_t code) {
+  uint16_t step = pgm_read_word(&adpcmStepTable[state.stepIndex]);
+  int32_t diff = step >> 3;
+  if (code & 4) diff += step;
+  if (code & 2) diff += step >> 1;
+  if (code & 1) diff += step >> 2;
+  int32_t predictor = state.predictor;
+  predictor += (code & 8) ? -diff : diff;
+  if (predictor > 32767) predictor = 32767;
+  else if (predictor < -32768) predictor = -32768;
+  state.predictor = (int16_t)predictor;
+
+  int8_t index = (int8_t)state.stepIndex + (int8_t)pgm_read_byte(&adpcmIndexTable[code]);
+  if (index < 0) index = 0;
+  else if (index > 88) index = 88;
+  state.stepIndex = (uint8_t)index;
+  return state.predictor;
+}
+
+static uint8_t adpcmEncodeSample(AdpcmState& state, int16_t sample) {
+  uint16_t step = pgm_read_word(&adpcmStepTable[state.stepIndex]);
+  int32_t diff = (int32_t)sample - state.predictor;
+  uint8_t code = 0;
+  if (diff < 0) {
+    code = 8;
+    diff = -diff;
+  }
+  if (diff >= step) {
+    code |= 4;
+    diff -= step;
+  }
+  step >>= 1;
+  if (diff >= step) {
+    code |= 2;
+    diff -= step;
+  }
+  step >>= 1;
+  if (diff >= step) {
+    code |= 1;
+  }
+  adpcmStep(state, code);
+  return code;
+}
+
+void adpcmEncode(AdpcmState& state, const int16_t* pcm, uint8_t* out, uint16_t samples) {
+  for (uint16_t i = 0; i < samples; i += 2) {
+    uint8_t low = adpcmEncodeSample(state, pcm[i]);
+    uint8_t high = adpcmEncodeSample(state, pcm[i + 1]);
+    *out++ = low | (high << 4);
+  }
+}
+
+void adpcmDecode(AdpcmState& state, const uint8_t* in, int16_t* pcm, uint16_t bytes) {
+  for (uint16_t i = 0; i < bytes; i++) {
+    *pcm++ = adpcmStep(state, in[i] & 0x0F);
+    *pcm++ = adpcmStep(state, in[i] >> 4);
+  }
+}
+
+// Chunk body: predictor (little endian), step index, ADPCM data
+static void decodeBody(const uint8_t* body, int16_t* pcm) {
+  AdpcmState state;
+  state.predictor = (int16_t)(body[0] | (body[1] << 8));
+  state.stepIndex = body[2] > 88 ? 88 : body[2];
+  adpcmDecode(state, body + 3, pcm, SOUND_CHUNK_DATA_SIZE);
+}
+
+static void xorBody(uint8_t* dst, const uint8_t* src) {
+  for (uint8_t i = 0; i < SOUND_CHUNK_BODY_SIZE; i++) {
+    dst[i] ^= src[i];
+  }
+}
+
+static uint8_t countBits(uint8_t v) {
+  uint8_t n = 0;
+  for (; v; v &= v - 1) n++;
+  return n;
+}
+
+
+//Constructor
+SoundStreamSender::SoundStreamSender(uint8_t fecGroup) {
+  state_.predictor = 0;
+  state_.stepIndex = 0;
+  seq_ = 0;
+  fecGroup_ = fecGroup > SOUND_MAX_FEC_GROUP ? SOUND_MAX_FEC_GROUP : fecGroup;
+  groupCount_ = 0;
+  groupStart_ = 0;
+}
+
+void SoundStreamSender::encode(const int16_t* pcm, MessageHelper& msg) {
+  // A chunk fills the whole payload, there is no room for extensions
+  msg.clearExtensions();
+  msg.setCommand(C_STREAM);
+  msg.setStreamType(ST_SOUND);
+  msg.setPayloadType(P_BYNARY_BYTE);
+
+  uint8_t* payload = (uint8_t*)msg.getPayload();
+  uint8_t* body = payload + SOUND_CHUNK_HEADER_SIZE;
+  payload[0] = seq_;
+  payload[1] = fecGroup_ ? groupCount_ : 0;
+  body[0] = (uint8_t)state_.predictor;
+  body[1] = (uint8_t)((uint16_t)state_.predictor >> 8);
+  body[2] = state_.stepIndex;
+  adpcmEncode(state_, pcm, body + 3, SOUND_CHUNK_SAMPLES);
+
+  if (fecGroup_) {
+    if (groupCount_ == 0) {
+      groupStart_ = seq_;
+      memset(parity_, 0, sizeof(parity_));
+    }
+    xorBody(parity_, body);
+    groupCount_++;
+  }
+  seq_++;
+}
+
+bool SoundStreamSender::parity(MessageHelper& msg) {
+  if (fecGroup_ == 0 || groupCount_ < fecGroup_) {
+    return false;
+  }
+  msg.clearExtensions();
+  msg.setCommand(C_STREAM);
+  msg.setStreamType(ST_SOUND);
+  msg.setPayloadType(P_BYNARY_BYTE);
+
+  uint8_t* payload = (uint8_t*)msg.getPayload();
+  payload[0] = groupStart_;
+  payload[1] = SOUND_FLAG_PARITY | fecGroup_;
+  memcpy(payload + SOUND_CHUNK_HEADER_SIZE, parity_, SOUND_CHUNK_BODY_SIZE);
+  groupCount_ = 0;
+  return true;
+}
+
+
+//Constructor
+SoundStreamReceiver::SoundStreamReceiver(uint8_t prefill) {
+  prefill_ = prefill > SOUND_JITTER_DEPTH ? SOUND_JITTER_DEPTH : prefill;
+  reset();
+}
+
+void SoundStreamReceiver::reset() {
+  valid_ = 0;
+  nextSeq_ = 0;
+  lossRun_ = 0;
+  started_ = false;
+  playing_ = false;
+  hasLast_ = false;
+  groupValid_ = false;
+  groupMask_ = 0;
+  received = recovered = concealed = late = 0;
+}
+
+bool SoundStreamReceiver::store(uint8_t seq, const uint8_t* body) {
+  if (!started_) {
+    started_ = true;
+    nextSeq_ = seq;
+  }
+  int8_t ahead = (int8_t)(seq - nextSeq_);
+  if (ahead < 0) {
+    late++;
+    return false;
+  }
+  if (ahead >= SOUND_JITTER_DEPTH) {
+    // The playout fell behind: skip the oldest chunks to keep the latency bounded
+    nextSeq_ = seq - (SOUND_JITTER_DEPTH - 1);
+    for (uint8_t i = 0; i < SOUND_JITTER_DEPTH; i++) {
+      if ((int8_t)(slotSeq_[i] - nextSeq_) < 0) {
+        valid_ &= ~(1 << i);
+      }
+    }
+  }
+  uint8_t slot = seq % SOUND_JITTER_DEPTH;
+  memcpy(body_[slot], body, SOUND_CHUNK_BODY_SIZE);
+  slotSeq_[slot] = seq;
+  valid_ |= 1 << slot;
+  return true;
+}
+
+void SoundStreamReceiver::recover(uint8_t groupStart, uint8_t groupSize, const uint8_t* parityBody) {
+  if (!groupValid_ || groupStart != groupStart_) {
+    // Nothing received from this group, only a group of one can be rebuilt
+    groupValid_ = true;
+    groupStart_ = groupStart;
+    groupMask_ = 0;
+    memset(groupXor_, 0, sizeof(groupXor_));
+  }
+  if (groupSize == 0 || groupSize > SOUND_MAX_FEC_GROUP || countBits(groupMask_) != groupSize - 1) {
+    return;
+  }
+  uint8_t missing = 0;
+  while (groupMask_ & (1 << missing)) missing++;
+  xorBody(groupXor_, parityBody);
+  if (store(groupStart + missing, groupXor_)) {
+    recovered++;
+  }
+  groupValid_ = false;
+}
+
+bool SoundStreamReceiver::push(const MessageHelper& msg) {
+  if (msg.getCommand() != C_STREAM || msg.getStreamType() != ST_SOUND ||
+      msg.getPayloadSize() < SOUND_CHUNK_HEADER_SIZE + SOUND_CHUNK_BODY_SIZE) {
+    return false;
+  }
+  const uint8_t* payload = (const uint8_t*)msg.getPayload();
+  const uint8_t* body = payload + SOUND_CHUNK_HEADER_SIZE;
+  uint8_t seq = payload[0];
+  uint8_t flags = payload[1];
+
+  if (flags & SOUND_FLAG_PARITY) {
+    recover(seq, flags & ~SOUND_FLAG_PARITY, body);
+    return true;
+  }
+
+  received++;
+  uint8_t index = flags;
+  if (index < SOUND_MAX_FEC_GROUP) {
+    // Late chunks still count for the parity of their group
+    uint8_t groupStart = seq - index;
+    if (!groupValid_ || (groupStart != groupStart_ && (int8_t)(groupStart - groupStart_) > 0)) {
+      groupValid_ = true;
+      groupStart_ = groupStart;
+      groupMask_ = 0;
+      memset(groupXor_, 0, sizeof(groupXor_));
+    }
+    if (groupStart == groupStart_ && !(groupMask_ & (1 << index))) {
+      groupMask_ |= 1 << index;
+      xorBody(groupXor_, body);
+    }
+  }
+  return store(seq, body);
+}
+
+Sound_pop_result SoundStreamReceiver::pop(int16_t* pcm) {
+  if (!started_) {
+    return SOUND_IDLE;
+  }
+  if (!playing_) {
+    if (countBits(valid_) < prefill_) {
+      return SOUND_IDLE;
+    }
+    playing_ = true;
+  }
+
+  uint8_t slot = nextSeq_ % SOUND_JITTER_DEPTH;
+  nextSeq_++;
+  if ((valid_ & (1 << slot)) && slotSeq_[slot] == (uint8_t)(nextSeq_ - 1)) {
+    valid_ &= ~(1 << slot);
+    decodeBody(body_[slot], pcm);
+    memcpy(last_, body_[slot], SOUND_CHUNK_BODY_SIZE);
+    hasLast_ = true;
+    lossRun_ = 0;
+    return SOUND_PLAYED;
+  }
+
+  // Concealment: repeat the last chunk, halving its level on every consecutive loss
+  concealed++;
+  lossRun_++;
+  if (hasLast_ && lossRun_ < 8) {
+    decodeBody(last_, pcm);
+    for (uint16_t i = 0; i < SOUND_CHUNK_SAMPLES; i++) {
+      pcm[i] >>= lossRun_;
+    }
+  } else {
+    memset(pcm, 0, SOUND_CHUNK_SAMPLES * sizeof(int16_t));
+  }
+  if (lossRun_ >= 8 && valid_ == 0) {
+    // The talker stopped, wait for the next burst and fill the buffer again
+    started_ = false;
+    playing_ = false;
+    lossRun_ = 0;
+  }
+  return SOUND_CONCEALED;
+}
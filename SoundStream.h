@@ -0,0 +1,140 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file SoundStream.h
+ *
+ * @brief Low bitrate ST_SOUND streaming over C_STREAM messages
+ *
+ * The sender encodes 16 bit PCM with IMA-ADPCM (4 bit per sample) and sends
+ * sequence numbered chunks. Every chunk carries the ADPCM state it was encoded
+ * with, so it can be decoded alone. Instead of ACKs, a XOR parity chunk is sent
+ * after every group of data chunks, which recovers one lost chunk per group.
+ * The receiver puts chunks in a jitter buffer and conceals the missing ones.
+ */
+#ifndef SOUNDSTREAM_H
+#define SOUNDSTREAM_H
+
+#include <Arduino.h>
+#include "Message.h"
+
+/// @brief Bytes of chunk header (sequence number and flags)
+#define SOUND_CHUNK_HEADER_SIZE 2
+/// @brief Bytes protected by the parity chunk (ADPCM state and data)
+#define SOUND_CHUNK_BODY_SIZE (MESSAGE_PAYLOAD_SIZE - SOUND_CHUNK_HEADER_SIZE)
+/// @brief Bytes of ADPCM data in a chunk, after predictor (2 bytes) and step index (1 byte)
+#define SOUND_CHUNK_DATA_SIZE (SOUND_CHUNK_BODY_SIZE - 3)
+/// @brief PCM samples carried by one chunk
+#define SOUND_CHUNK_SAMPLES (SOUND_CHUNK_DATA_SIZE * 2)
+
+/// @brief Number of chunks the receiver can hold
+#ifndef SOUND_JITTER_DEPTH
+#define SOUND_JITTER_DEPTH 4
+#endif
+#if SOUND_JITTER_DEPTH > 8
+#error "SOUND_JITTER_DEPTH must not exceed 8"
+#endif
+
+/// @brief Maximum number of data chunks protected by one parity chunk. A group
+/// must fit in the receiver buffer to be rebuilt, so it cannot exceed SOUND_JITTER_DEPTH.
+#ifndef SOUND_MAX_FEC_GROUP
+#define SOUND_MAX_FEC_GROUP SOUND_JITTER_DEPTH
+#endif
+#if SOUND_MAX_FEC_GROUP > SOUND_JITTER_DEPTH
+#error "SOUND_MAX_FEC_GROUP must not exceed SOUND_JITTER_DEPTH"
+#endif
+/// @brief Default parity group of the sender, and default prefill of the receiver
+#ifndef SOUND_FEC_GROUP
+#define SOUND_FEC_GROUP 4
+#endif
+#if SOUND_FEC_GROUP > SOUND_MAX_FEC_GROUP
+#error "SOUND_FEC_GROUP must not exceed SOUND_MAX_FEC_GROUP"
+#endif
+
+/// @brief Chunk flag (second byte of the payload) of a parity chunk. The low bits
+/// hold the group size in a parity chunk and the index in the group in a data chunk.
+#define SOUND_FLAG_PARITY 0x80
+
+/// @brief Result of SoundStreamReceiver::pop()
+typedef enum : unsigned char {
+	SOUND_IDLE				= 0,	//!< Nothing to play yet, the buffer is still filling
+	SOUND_PLAYED			= 1,	//!< A received or recovered chunk has been decoded
+	SOUND_CONCEALED			= 2		//!< The chunk was lost, the output is concealment
+} Sound_pop_result;
+
+/// @brief IMA-ADPCM codec state
+typedef struct {
+	int16_t predictor;
+	uint8_t stepIndex;
+} AdpcmState;
+
+/// @brief Encodes @p samples PCM samples (must be even) into samples/2 bytes
+void adpcmEncode(AdpcmState& state, const int16_t* pcm, uint8_t* out, uint16_t samples);
+/// @brief Decodes bytes*2 PCM samples
+void adpcmDecode(AdpcmState& state, const uint8_t* in, int16_t* pcm, uint16_t bytes);
+
+
+class SoundStreamSender {
+
+ public:
+	/// @param fecGroup data chunks per parity chunk, 0 disables the parity (max SOUND_MAX_FEC_GROUP)
+	SoundStreamSender(uint8_t fecGroup = SOUND_FEC_GROUP);
+	/// @brief Encodes SOUND_CHUNK_SAMPLES samples into the next data chunk
+	void encode(const int16_t* pcm, MessageHelper& msg);
+	/// @brief Fills @p msg with the parity chunk when a group is complete
+	/// @return true if a parity chunk must be sent after the last data chunk
+	bool parity(MessageHelper& msg);
+
+ private:
+	AdpcmState state_;
+	uint8_t seq_;
+	uint8_t fecGroup_;
+	uint8_t groupCount_;
+	uint8_t groupStart_;
+	uint8_t parity_[SOUND_CHUNK_BODY_SIZE];
+};
+
+
+class SoundStreamReceiver {
+
+ public:
+	/// @param prefill chunks to buffer before the playout starts (latency vs jitter).
+	/// A lost chunk can only be rebuilt in time if prefill is at least the sender fecGroup.
+	SoundStreamReceiver(uint8_t prefill = SOUND_FEC_GROUP);
+	/// @brief Stores a received ST_SOUND chunk
+	/// @return false if the message is not usable (not a sound chunk, or too late)
+	bool push(const MessageHelper& msg);
+	/// @brief Decodes the next chunk in SOUND_CHUNK_SAMPLES samples, call it at the playout rate
+	Sound_pop_result pop(int16_t* pcm);
+	void reset();
+
+	uint16_t received;		//!< Data chunks received
+	uint16_t recovered;		//!< Chunks rebuilt from parity
+	uint16_t concealed;		//!< Chunks replaced by concealment
+	uint16_t late;			//!< Chunks received after their playout
+
+ private:
+	bool store(uint8_t seq, const uint8_t* body);
+	void recover(uint8_t groupStart, uint8_t groupSize, const uint8_t* parityBody);
+
+	uint8_t body_[SOUND_JITTER_DEPTH][SOUND_CHUNK_BODY_SIZE];
+	uint8_t last_[SOUND_CHUNK_BODY_SIZE];
+	uint8_t slotSeq_[SOUND_JITTER_DEPTH];
+	uint8_t valid_;
+	uint8_t nextSeq_;
+	uint8_t prefill_;
+	uint8_t lossRun_;
+	bool started_;
+	bool playing_;
+	bool hasLast_;
+	// XOR of the data chunks received in the current parity group
+	uint8_t groupXor_[SOUND_CHUNK_BODY_SIZE];
+	uint8_t groupStart_;
+	uint8_t groupMask_;
+	bool groupValid_;
+};
+
+#endif
@@ -0,0 +1,80 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+
+#include "TaskScheduler.h"
+
+//Constructor
+TaskScheduler::TaskScheduler() {
+  for (uint8_t i = 0; i < TASK_LANES; i++) {
+    head_[i] = 0;
+    count_[i] = 0;
+  }
+  resetStats();
+}
+
+bool TaskScheduler::post(Task_lane lane, TaskFunction task, void* context) {
+  if (lane >= TASK_LANES || task == NULL) {
+    return false;
+  }
+  if (count_[lane] == TASK_QUEUE_SIZE) {
+    stats_[lane].dropped++;
+    return false;
+  }
+  Task& slot = queue_[lane][(head_[lane] + count_[lane]) % TASK_QUEUE_SIZE];
+  slot.task = task;
+  slot.context = context;
+  slot.posted = micros();
+  count_[lane]++;
+  return true;
+}
+
+bool TaskScheduler::runOne(uint8_t lane) {
+  if (count_[lane] == 0) {
+    return false;
+  }
+  // Copy the task out first, it may post in its own lane
+  Task task = queue_[lane][head_[lane]];
+  head_[lane] = (head_[lane] + 1) % TASK_QUEUE_SIZE;
+  count_[lane]--;
+
+  uint32_t wait = micros() - task.posted;
+  LaneStats& stats = stats_[lane];
+  stats.executed++;
+  stats.totalWait += wait;
+  if (wait > stats.maxWait) {
+    stats.maxWait = wait;
+  }
+  task.task(task.context);
+  return true;
+}
+
+uint8_t TaskScheduler::run() {
+  uint8_t done = 0;
+  // Bounded by the queue size, so dispatch tasks posting more dispatch tasks cannot starve the others
+  for (uint8_t i = 0; i < TASK_QUEUE_SIZE && runOne(LANE_DISPATCH); i++) {
+    done++;
+  }
+  for (uint8_t lane = LANE_DISPATCH + 1; lane < TASK_LANES; lane++) {
+    if (runOne(lane)) {
+      done++;
+      break;
+    }
+  }
+  return done;
+}
+
+uint8_t TaskScheduler::pending(Task_lane lane) const {
+  return lane < TASK_LANES ? count_[lane] : 0;
+}
+
+const LaneStats& TaskScheduler::stats(Task_lane lane) const {
+  return stats_[lane < TASK_LANES ? lane : LANE_BULK];
+}
+
+void TaskScheduler::resetStats() {
+  memset(stats_, 0, sizeof(stats_));
+}
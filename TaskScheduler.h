@@ -0,0 +1,75 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * version 2 as published by the Free Software Foundation.
+ */
+
+/**
+ * @file TaskScheduler.h
+ *
+ * @brief Cooperative scheduler with priority lanes for the gateway loop()
+ *
+ * Work is posted as a function and a context in one of the lanes. run() first
+ * drains the dispatch lane, then runs a single task of the highest non-empty
+ * lane below it, so message dispatch never waits behind more than one
+ * background job (rule evaluation, rollups, compaction...). The time every task
+ * spends in its queue is measured per lane.
+ */
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <Arduino.h>
+
+/// @brief Number of tasks each lane can hold
+#ifndef TASK_QUEUE_SIZE
+#define TASK_QUEUE_SIZE 8
+#endif
+
+/// @brief Priority lanes, from the most urgent
+typedef enum : unsigned char {
+	LANE_DISPATCH			= 0,	//!< Message dispatch, latency critical
+	LANE_NORMAL				= 1,	//!< Short jobs (rules, replies)
+	LANE_BULK				= 2,	//!< Long jobs (rollups, compaction, OTA preparation)
+	TASK_LANES				= 3
+} Task_lane;
+
+typedef void (*TaskFunction)(void* context);
+
+/// @brief Queue time statistics of a lane, in microseconds
+typedef struct {
+	uint32_t executed;		//!< Tasks run
+	uint32_t totalWait;		//!< Sum of the queue times
+	uint32_t maxWait;		//!< Longest queue time
+	uint16_t dropped;		//!< Tasks refused because the lane was full
+} LaneStats;
+
+
+class TaskScheduler {
+
+ public:
+	TaskScheduler();
+	/// @return false if the lane is full
+	bool post(Task_lane lane, TaskFunction task, void* context = NULL);
+	/// @brief Runs the dispatch lane and at most one other task, call it from loop()
+	/// @return number of tasks run
+	uint8_t run();
+	uint8_t pending(Task_lane lane) const;
+	const LaneStats& stats(Task_lane lane) const;
+	void resetStats();
+
+ private:
+	typedef struct {
+		TaskFunction task;
+		void* context;
+		uint32_t posted;
+	} Task;
+
+	bool runOne(uint8_t lane);
+
+	Task queue_[TASK_LANES][TASK_QUEUE_SIZE];
+	uint8_t head_[TASK_LANES];
+	uint8_t count_[TASK_LANES];
+	LaneStats stats_[TASK_LANES];
+};
+
+#endif